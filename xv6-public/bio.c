@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -17,42 +17,227 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// Buffers are hashed by (dev, blockno) into NBUCKET chains, each
+// with its own lock, so lookups of different blocks do not
+// contend. A bucket lock protects its chain, its list of
+// reusable buffers, and the refcnt and lastuse of the buffers on
+// it. bcache.lock serializes the insertion of new blocks: it
+// protects the free list and is held while choosing a buffer to
+// recycle.
+//
+// The cache starts with NBUF static buffers and grows a page of
+// block data at a time, up to 1/BCACHEFRAC of physical memory,
+// as long as at least a quarter of memory is still free. The
+// buf headers of grown buffers are carved from pages of their own,
+// since a page may hold a single block. initlog() uses breserve()
+// to grow it past those limits, so that the blocks the log pins
+// always fit. Once it cannot grow, the least recently released
+// unreferenced buffer is recycled. Each bucket keeps its clean,
+// unreferenced buffers on a list in the order they were released,
+// so finding that buffer means looking at the head of each list.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
 
+#define NBUCKET    61  // number of hash chains; prime
+#define BCACHEFRAC  8  // cache may use 1/BCACHEFRAC of memory
+#define BPP (PGSIZE/BSIZE)               // blocks per page
+#define HPP (PGSIZE/sizeof(struct buf))  // buf headers per page
+
+#define BHASH(dev, blockno) (((dev)*31 + (blockno)) % NBUCKET)
+
+struct bucket {
+  struct spinlock lock;
+  struct buf *head;   // Hash chain, through hnext
+  struct buf *lru;    // Reusable buffers, least recently released
+  struct buf *mru;    //   first, through lnext; most recent
+  uint hits;          // Lookups that found the block cached
+  uint misses;        // Lookups that had to read the disk
+};
+
+static uchar bufdata[NBUF][BSIZE] __attribute__((aligned(BSIZE)));
+
 struct {
   struct spinlock lock;
   struct buf buf[NBUF];
+  struct bucket bucket[NBUCKET];
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
+  struct buf *free;   // Buffers never yet used, through hnext
+  struct buf *hdr;    // Unused headers in the last header page
+  int nhdr;           // How many
+  int nbuf;           // Buffers allocated so far
+  int npage;          // Pages allocated for buffers
+  uint evictions;     // Buffers recycled for another block
+  uint raissued;      // Read-ahead requests sent to the disk
+  uint raused;        // Read-ahead blocks later read by bread()
 } bcache;
 
 void
 binit(void)
 {
   struct buf *b;
+  struct bucket *bk;
 
   initlock(&bcache.lock, "bcache");
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++)
+    initlock(&bk->lock, "bcache.bucket");
 
 //PAGEBREAK!
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
+  // Put the static buffers on the free list.
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->data = bufdata[b - bcache.buf];
+    b->hnext = bcache.free;
+    bcache.free = b;
+  }
+  bcache.nbuf = NBUF;
+}
+
+// Add a page of fresh buffers to the free list, if the
+// cache is allowed to grow or force is set.
+// Caller must hold bcache.lock.
+static void
+bgrow(int force)
+{
+  struct buf *b;
+  char *mem;
+  int i;
+
+  if(!force && (bcache.npage >= ktotalpages() / BCACHEFRAC ||
+                kfreepages() < ktotalpages() / 4))
+    return;
+  if(bcache.nhdr < BPP){
+    if((mem = kalloc()) == 0)
+      return;
+    memset(mem, 0, PGSIZE);
+    bcache.hdr = (struct buf*)mem;
+    bcache.nhdr = HPP;
+    bcache.npage++;
+  }
+  if((mem = kalloc()) == 0)
+    return;
+  for(i = 0; i < BPP; i++){
+    b = &bcache.hdr[--bcache.nhdr];
+    initsleeplock(&b->lock, "buffer");
+    b->data = (uchar*)mem + i*BSIZE;
+    b->hnext = bcache.free;
+    bcache.free = b;
+  }
+  bcache.npage++;
+  bcache.nbuf += BPP;
+}
+
+// Grow the cache to at least n buffers, even past the limits
+// bgrow() normally keeps to, and return how many it has. The
+// cache never shrinks, so the log can count on that many.
+int
+breserve(int n)
+{
+  int nbuf;
+
+  acquire(&bcache.lock);
+  do {
+    nbuf = bcache.nbuf;
+    if(nbuf >= n)
+      break;
+    bgrow(1);
+  } while(bcache.nbuf > nbuf);
+  nbuf = bcache.nbuf;
+  release(&bcache.lock);
+  return nbuf;
+}
+
+// Append b, which nobody is using and the log has not pinned,
+// to bucket bk's list of reusable buffers.
+// Caller must hold bk->lock.
+static void
+lruadd(struct bucket *bk, struct buf *b)
+{
+  b->lnext = 0;
+  b->lprev = bk->mru;
+  if(bk->mru)
+    bk->mru->lnext = b;
+  else
+    bk->lru = b;
+  bk->mru = b;
+  b->onlru = 1;
+}
+
+// Take b off bucket bk's list of reusable buffers, if it is on it.
+// Caller must hold bk->lock.
+static void
+lrudel(struct bucket *bk, struct buf *b)
+{
+  if(!b->onlru)
+    return;
+  if(b->lprev)
+    b->lprev->lnext = b->lnext;
+  else
+    bk->lru = b->lnext;
+  if(b->lnext)
+    b->lnext->lprev = b->lprev;
+  else
+    bk->mru = b->lprev;
+  b->onlru = 0;
+}
+
+// Unhash and return the least recently released buffer
+// that nobody is using, or 0 if there is none. That is the
+// oldest of the buffers at the heads of the buckets' lists.
+// Caller must hold bcache.lock. Only this function holds
+// two bucket locks at once, and bcache.lock ensures only
+// one process runs it at a time, so it cannot deadlock.
+static struct buf*
+bevict(void)
+{
+  struct bucket *bk, *bestbk;
+  struct buf *best, **pp;
+
+  best = 0;
+  bestbk = 0;
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    acquire(&bk->lock);
+    // Keep holding the lock of the bucket that holds best,
+    // so that best cannot be taken before we unhash it.
+    if(bk->lru && (best == 0 || bk->lru->lastuse < best->lastuse)){
+      if(bestbk)
+        release(&bestbk->lock);
+      best = bk->lru;
+      bestbk = bk;
+    } else
+      release(&bk->lock);
   }
+  if(best == 0)
+    return 0;
+
+  lrudel(bestbk, best);
+  for(pp = &bestbk->head; *pp != best; pp = &(*pp)->hnext)
+    ;
+  *pp = best->hnext;
+  release(&bestbk->lock);
+  bcache.evictions++;
+  return best;
+}
+
+// Return the buffer for block blockno on device dev in
+// bucket bk, or 0 if it is not cached.
+// Caller must hold bk->lock.
+static struct buf*
+bfind(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bk->head; b; b = b->hnext)
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+  return 0;
 }
 
 // Look through buffer cache for block on device dev.
@@ -61,35 +246,60 @@ binit(void)
 static struct buf*
 bget(uint dev, uint blockno)
 {
+  struct bucket *bk;
   struct buf *b;
 
-  acquire(&bcache.lock);
+  bk = &bcache.bucket[BHASH(dev, blockno)];
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, blockno)) != 0){
+    b->refcnt++;
+    lrudel(bk, b);
+    bk->hits++;
+    release(&bk->lock);
+    acquiresleep(&b->lock);
+    return b;
   }
+  release(&bk->lock);
 
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  // Not cached. Only one process at a time inserts blocks;
+  // look again once we are that process, in case another
+  // one cached the block in the meantime.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, blockno)) != 0){
+    b->refcnt++;
+    lrudel(bk, b);
+    bk->hits++;
+    release(&bk->lock);
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    return b;
   }
-  panic("bget: no buffers");
+  bk->misses++;
+  release(&bk->lock);
+
+  // Take a fresh buffer if the cache may grow,
+  // otherwise recycle an unused one.
+  if(bcache.free == 0)
+    bgrow(0);
+  if((b = bcache.free) != 0)
+    bcache.free = b->hnext;
+  else if((b = bevict()) == 0)
+    panic("bget: no buffers");
+
+  b->dev = dev;
+  b->blockno = blockno;
+  b->flags = 0;
+  b->refcnt = 1;
+  acquire(&bk->lock);
+  b->hnext = bk->head;
+  bk->head = b;
+  release(&bk->lock);
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -102,9 +312,73 @@ bread(uint dev, uint blockno)
   if((b->flags & B_VALID) == 0) {
     iderw(b);
   }
+  if(b->flags & B_RAHEAD){
+    b->flags &= ~B_RAHEAD;
+    __sync_fetch_and_add(&bcache.raused, 1);
+  }
   return b;
 }
 
+// Return a locked buf for the indicated block, zeroed,
+// without reading the disk.
+struct buf*
+bzeroed(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  memset(b->data, 0, BSIZE);
+  b->flags |= B_VALID;
+  return b;
+}
+
+// Return locked bufs in bp[0..n-1] with the contents of
+// blocks blocknos[0..n-1]. The blocks that are not cached are
+// read with a single request to the disk driver, so that it
+// can sort them and merge runs of consecutive blocks.
+// n must be at most MAXOPBLOCKS.
+void
+breadv(uint dev, uint *blocknos, int n, struct buf **bp)
+{
+  struct buf *rd[MAXOPBLOCKS];
+  int i, nrd;
+
+  if(n > MAXOPBLOCKS)
+    panic("breadv");
+  nrd = 0;
+  for(i = 0; i < n; i++){
+    bp[i] = bget(dev, blocknos[i]);
+    if((bp[i]->flags & B_VALID) == 0)
+      rd[nrd++] = bp[i];
+  }
+  if(nrd > 0)
+    iderwv(rd, nrd);
+  for(i = 0; i < n; i++){
+    if(bp[i]->flags & B_RAHEAD){
+      bp[i]->flags &= ~B_RAHEAD;
+      __sync_fetch_and_add(&bcache.raused, 1);
+    }
+  }
+}
+
+// Start reading the indicated block into the cache
+// without waiting for the disk, so that a later bread()
+// finds it there. Does nothing if it is already cached.
+void
+breadahead(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  if(b->flags & B_VALID){
+    brelse(b);
+    return;
+  }
+  b->flags |= B_RAHEAD;
+  __sync_fetch_and_add(&bcache.raissued, 1);
+  idereadasync(b);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -115,8 +389,45 @@ bwrite(struct buf *b)
   iderw(b);
 }
 
+// Drop a reference to b.
+// Stamp it with the time so that bevict() can find
+// the least recently used buffer.
+static void
+bput(struct buf *b)
+{
+  struct bucket *bk;
+
+  bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+  acquire(&bk->lock);
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    // no one is waiting for it. Even so, B_DIRTY indicates a
+    // buffer is in use because log.c has modified it but not
+    // yet committed it; it becomes reusable when it is next
+    // released clean.
+    b->lastuse = ticks;
+    if((b->flags & B_DIRTY) == 0)
+      lruadd(bk, b);
+  }
+  release(&bk->lock);
+}
+
+// Write the contents of n locked bufs to disk
+// with a single request to the disk driver.
+void
+bwritev(struct buf **bp, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&bp[i]->lock))
+      panic("bwritev");
+    bp[i]->flags |= B_DIRTY;
+  }
+  iderwv(bp, n);
+}
+
 // Release a locked buffer.
-// Move to the head of the MRU list.
 void
 brelse(struct buf *b)
 {
@@ -124,21 +435,45 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
+  bput(b);
+}
 
-  acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+// Finish an asynchronous read started by breadahead().
+// Called by the disk driver, possibly from an interrupt,
+// so it cannot use brelse(): the lock belongs to the
+// process that started the read.
+void
+bdone(struct buf *b)
+{
+  releasesleep(&b->lock);
+  bput(b);
+}
+
+// Print buffer cache statistics, then zero the
+// counters if reset is set.
+void
+bstat(int reset)
+{
+  struct bucket *bk;
+  uint hits, misses;
+
+  hits = misses = 0;
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    acquire(&bk->lock);
+    hits += bk->hits;
+    misses += bk->misses;
+    if(reset)
+      bk->hits = bk->misses = 0;
+    release(&bk->lock);
   }
-  
+  acquire(&bcache.lock);
+  cprintf("bcache: %d buffers, %d hits, %d misses, %d evictions\n",
+          bcache.nbuf, hits, misses, bcache.evictions);
+  cprintf("readahead: %d blocks issued, %d used\n",
+          bcache.raissued, bcache.raused);
+  if(reset)
+    bcache.evictions = bcache.raissued = bcache.raused = 0;
   release(&bcache.lock);
 }
 //PAGEBREAK!
 // Blank page.
-
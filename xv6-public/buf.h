@@ -4,11 +4,16 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  uint lastuse;      // ticks when refcnt last dropped to zero
+  struct buf *hnext; // hash chain or free list
+  struct buf *lprev; // bucket's list of reusable buffers
+  struct buf *lnext;
+  int onlru;         // on that list
   struct buf *qnext; // disk queue
-  uchar data[BSIZE];
+  uchar *data;       // BSIZE bytes
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
+#define B_ASYNC 0x8  // read in flight; driver calls bdone() when done
+#define B_RAHEAD 0x10 // read ahead and not yet used
 
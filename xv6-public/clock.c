@@ -0,0 +1,162 @@
+// High-resolution time.
+//
+// lapicinit() calibrates the TSC and the LAPIC timer against
+// the PIT at boot. From then on each CPU's LAPIC timer is
+// one-shot: clockintr() arms it for the earlier of the CPU's
+// next clock tick and the earliest nanosleep() deadline, so
+// short sleeps end on time rather than at the next tick.
+// Ticks are counted from the TSC, so an interrupt that comes
+// late does not lose them.
+//
+// If calibration failed (tsckhz is 0), the timer stays
+// periodic, and time is only as fine as a tick.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "date.h"
+
+#define TICKCYCLES (tsckhz*(1000/TICKHZ))   // TSC cycles per tick
+
+struct {
+  struct spinlock lock;
+  uint64 at[NPROC];   // TSC deadlines of sleepers in nsleep(); 0 if free
+} timers;
+
+// Return n/d and set *rem to the remainder.
+static uint64
+div64(uint64 n, uint d, uint *rem)
+{
+  uint hi, lo, qhi, qlo;
+
+  hi = n >> 32;
+  lo = n;
+  qhi = hi / d;
+  hi = hi % d;
+  asm("divl %4" : "=a" (qlo), "=d" (*rem) : "0" (lo), "1" (hi), "rm" (d));
+  return (uint64)qhi << 32 | qlo;
+}
+
+void
+clockinit(void)
+{
+  initlock(&timers.lock, "timers");
+}
+
+// Start this CPU's clock ticks.
+void
+clockstart(void)
+{
+  if(tsckhz == 0)
+    return;
+  mycpu()->nexttick = rdtsc() + TICKCYCLES;
+  mycpu()->armed = mycpu()->nexttick;
+  lapicarm(TICKCYCLES);
+}
+
+// Handle this CPU's timer interrupt: wake nanosleep() callers
+// whose deadlines have passed and rearm the timer. Returns the
+// number of clock ticks since the last call.
+int
+clockintr(void)
+{
+  struct cpu *c;
+  uint64 now, next;
+  int i, n;
+
+  if(tsckhz == 0)
+    return 1;
+  c = mycpu();
+  now = rdtsc();
+  for(n = 0; c->nexttick <= now; n++)
+    c->nexttick += TICKCYCLES;
+  next = c->nexttick;
+
+  acquire(&timers.lock);
+  for(i = 0; i < NPROC; i++){
+    if(timers.at[i] == 0)
+      continue;
+    if(timers.at[i] <= now)
+      wakeup(&timers.at[i]);
+    else if(timers.at[i] < next)
+      next = timers.at[i];
+  }
+  release(&timers.lock);
+
+  c->armed = next;
+  lapicarm(next - now);
+  return n;
+}
+
+// Time since the TSC was calibrated, or since the
+// first tick if it was not.
+void
+nanotime(struct timespec *ts)
+{
+  uint64 ms;
+  uint rem, msrem;
+
+  if(tsckhz == 0){
+    acquire(&tickslock);
+    ts->tv_sec = ticks / TICKHZ;
+    ts->tv_nsec = (ticks % TICKHZ) * (1000000000 / TICKHZ);
+    release(&tickslock);
+    return;
+  }
+  ms = div64(rdtsc() - tscboot, tsckhz, &rem);
+  ts->tv_sec = div64(ms, 1000, &msrem);
+  ts->tv_nsec = msrem*1000000 + muldiv(rem, 1000000, tsckhz);
+}
+
+// Sleep for the time in ts. Returns -1 if killed.
+int
+nsleep(struct timespec *ts)
+{
+  uint64 at, now;
+  uint ticks0, n;
+  int i;
+
+  if(tsckhz == 0){
+    // Round up to whole ticks.
+    n = ts->tv_sec*TICKHZ + (ts->tv_nsec + 1000000000/TICKHZ - 1) / (1000000000/TICKHZ);
+    acquire(&tickslock);
+    ticks0 = ticks;
+    while(ticks - ticks0 < n){
+      if(myproc()->killed){
+        release(&tickslock);
+        return -1;
+      }
+      sleep(&ticks, &tickslock);
+    }
+    release(&tickslock);
+    return 0;
+  }
+
+  at = rdtsc() + (uint64)ts->tv_sec*tsckhz*1000 +
+    (uint64)(ts->tv_nsec / 1000000)*tsckhz +
+    muldiv(ts->tv_nsec % 1000000, tsckhz, 1000000);
+  acquire(&timers.lock);
+  for(i = 0; timers.at[i]; i++)  // a free slot, since NPROC
+    ;
+  timers.at[i] = at;
+  while((now = rdtsc()) < at){
+    if(myproc()->killed){
+      timers.at[i] = 0;
+      release(&timers.lock);
+      return -1;
+    }
+    // Have this CPU's timer go off by the deadline.
+    if(at < mycpu()->armed){
+      mycpu()->armed = at;
+      lapicarm(at - now);
+    }
+    sleep(&timers.at[i], &timers.lock);
+  }
+  timers.at[i] = 0;
+  release(&timers.lock);
+  return 0;
+}
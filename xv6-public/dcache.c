@@ -0,0 +1,186 @@
+// Directory entry cache: remembers the results of dirlookup(),
+// so that resolving a path does not scan each directory.
+//
+// An entry maps (dev, directory i-number, name) to the i-number
+// and byte offset of the directory entry, or records that the
+// name is absent (inum 0, a negative entry). Directory contents
+// change only with the directory's inode locked, and callers of
+// these functions hold that lock, so an entry cannot go stale
+// between the lookup and its use. dirlink() and unlink() update
+// the cache as they write the directory, and iput() purges a
+// directory's entries when it frees the inode.
+//
+// Entries hash into NDHASH chains; when all NDENTRY are in use,
+// the least recently used one is recycled.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "fs.h"
+
+#define NDENTRY 256   // cached names
+#define NDHASH   61   // hash chains; prime
+
+struct dentry {
+  uint dev;
+  uint dir;              // i-number of the directory
+  char name[DIRSIZ];
+  uint inum;             // 0: name is not in the directory
+  uint off;              // byte offset of the entry
+  uint lastuse;          // dcache.clock at last use
+  struct dentry *next;   // hash chain or free list
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry entry[NDENTRY];
+  struct dentry *hash[NDHASH];
+  struct dentry *free;
+  uint clock;
+  uint hits;             // lookups answered with an i-number
+  uint neghits;          // lookups answered "not present"
+  uint misses;           // lookups that had to scan the directory
+} dcache;
+
+void
+dcacheinit(void)
+{
+  struct dentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  for(d = dcache.entry; d < dcache.entry+NDENTRY; d++){
+    d->next = dcache.free;
+    dcache.free = d;
+  }
+}
+
+static uint
+dhash(uint dev, uint dir, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev*31 + dir;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h*31 + (uchar)name[i];
+  return h % NDHASH;
+}
+
+// Find the entry for name in directory dir.
+// Caller must hold dcache.lock.
+static struct dentry*
+dfind(uint dev, uint dir, char *name)
+{
+  struct dentry *d;
+
+  for(d = dcache.hash[dhash(dev, dir, name)]; d; d = d->next)
+    if(d->dev == dev && d->dir == dir && namecmp(d->name, name) == 0)
+      return d;
+  return 0;
+}
+
+// Unhash d. Caller must hold dcache.lock.
+static void
+dunhash(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = &dcache.hash[dhash(d->dev, d->dir, d->name)]; *pp; pp = &(*pp)->next){
+    if(*pp == d){
+      *pp = d->next;
+      return;
+    }
+  }
+  panic("dunhash");
+}
+
+// Look name up in directory dir of dev. Returns 1 and sets
+// *pinum and *poff if the cache knows the answer; *pinum is 0
+// if the name is known to be absent. Returns 0 on a miss.
+// Caller must hold the directory's inode lock.
+int
+dcachelookup(uint dev, uint dir, char *name, uint *pinum, uint *poff)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dev, dir, name)) == 0){
+    dcache.misses++;
+    release(&dcache.lock);
+    return 0;
+  }
+  d->lastuse = ++dcache.clock;
+  *pinum = d->inum;
+  *poff = d->off;
+  if(d->inum)
+    dcache.hits++;
+  else
+    dcache.neghits++;
+  release(&dcache.lock);
+  return 1;
+}
+
+// Record that name in directory dir is i-number inum at byte
+// offset off, or absent if inum is 0.
+// Caller must hold the directory's inode lock.
+void
+dcacheenter(uint dev, uint dir, char *name, uint inum, uint off)
+{
+  struct dentry *d, *e;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dev, dir, name)) == 0){
+    if((d = dcache.free) != 0)
+      dcache.free = d->next;
+    else {
+      for(e = dcache.entry; e < dcache.entry+NDENTRY; e++)
+        if(d == 0 || e->lastuse < d->lastuse)
+          d = e;
+      dunhash(d);
+    }
+    d->dev = dev;
+    d->dir = dir;
+    strncpy(d->name, name, DIRSIZ);
+    d->next = dcache.hash[dhash(dev, dir, name)];
+    dcache.hash[dhash(dev, dir, name)] = d;
+  }
+  d->inum = inum;
+  d->off = off;
+  d->lastuse = ++dcache.clock;
+  release(&dcache.lock);
+}
+
+// Forget every entry of directory dir, which is being freed.
+void
+dcachepurge(uint dev, uint dir)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.entry; d < dcache.entry+NDENTRY; d++){
+    if(d->lastuse && d->dev == dev && d->dir == dir){
+      dunhash(d);
+      d->lastuse = 0;
+      d->next = dcache.free;
+      dcache.free = d;
+    }
+  }
+  release(&dcache.lock);
+}
+
+// Print dcache statistics to the console; with reset, zero them.
+void
+dcachestat(int reset)
+{
+  uint n;
+
+  acquire(&dcache.lock);
+  n = dcache.hits + dcache.neghits + dcache.misses;
+  cprintf("dcache: %d lookups, %d hits, %d negative hits, %d misses (%d%% hit)\n",
+          n, dcache.hits, dcache.neghits, dcache.misses,
+          n ? (dcache.hits + dcache.neghits) * 100 / n : 0);
+  if(reset)
+    dcache.hits = dcache.neghits = dcache.misses = 0;
+  release(&dcache.lock);
+}
@@ -2,19 +2,37 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
 struct pipe;
 struct proc;
 struct rtcdate;
+struct rwlock;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct timespec;
+struct vdata;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+void            breadahead(uint, uint);
+void            breadv(uint, uint*, int, struct buf**);
+void            bwritev(struct buf**, int);
+void            bdone(struct buf*);
 void            brelse(struct buf*);
+int             breserve(int);
 void            bwrite(struct buf*);
+void            bstat(int);
+struct buf*     bzeroed(uint, uint);
+
+// clock.c
+void            clockinit(void);
+int             clockintr(void);
+void            clockstart(void);
+void            nanotime(struct timespec*);
+int             nsleep(struct timespec*);
 
 // console.c
 void            consoleinit(void);
@@ -25,24 +43,42 @@ void            panic(char*) __attribute__((noreturn));
 // exec.c
 int             exec(char*, char**);
 
+// dcache.c
+void            dcacheinit(void);
+int             dcachelookup(uint, uint, char*, uint*, uint*);
+void            dcacheenter(uint, uint, char*, uint, uint);
+void            dcachepurge(uint, uint);
+void            dcachestat(int);
+
 // file.c
 struct file*    filealloc(void);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
+int             filereadv(struct file*, struct iovec*, int, uint*);
+int             filesplice(struct file*, struct file*, int n);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filewritev(struct file*, struct iovec*, int, uint*);
+
+// futex.c
+void            futexinit(void);
+int             futexwait(uint, int);
+int             futexwake(uint, int);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
+void            bsummary(int dev);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
+void            ireadahead(struct inode*, uint, uint);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
 void            iput(struct inode*);
+void            istat(int);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
@@ -57,6 +93,9 @@ int             writei(struct inode*, char*, uint, uint);
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            iderwv(struct buf**, int);
+void            idestat(int);
+void            idereadasync(struct buf*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -66,6 +105,8 @@ void            ioapicinit(void);
 // kalloc.c
 char*           kalloc(void);
 void            kfree(char*);
+int             kfreepages(void);
+int             ktotalpages(void);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
 
@@ -77,15 +118,23 @@ void            cmostime(struct rtcdate *r);
 int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
+void            lapicarm(uint);
 void            lapicinit(void);
+extern uint     lapickhz;
+extern uint64   tscboot;
+extern uint     tsckhz;
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
 // log.c
 void            initlog(int dev);
 void            log_write(struct buf*);
+void            log_data(struct buf*);
+int             log_inuse(uint);
 void            begin_op();
 void            end_op();
+void            log_sync(void);
+void            logstat(int);
 
 // mp.c
 extern int      ismp;
@@ -97,10 +146,19 @@ void            picinit(void);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
+int             pipebeginread(struct pipe*, char**, int, int);
+int             pipebeginwrite(struct pipe*, char**, int);
 void            pipeclose(struct pipe*, int);
+void            pipeendread(struct pipe*, int);
+void            pipeendwrite(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
 
+// pci.c
+uint            pciconfread(uint, int);
+void            pciconfwrite(uint, int, uint);
+int             pcifind(int, int, uint*);
+
 //PAGEBREAK: 16
 // proc.c
 int             cpuid(void);
@@ -108,6 +166,7 @@ void            exit(void);
 int             fork(void);
 int             growproc(int);
 int             kill(int);
+void            kthread(char*, void (*)(void));
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
@@ -129,10 +188,19 @@ void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+int             lockstatdump(int);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
+// rwlock.c
+void            acquireread(struct rwlock*);
+void            acquirewrite(struct rwlock*);
+int             holdingwrite(struct rwlock*);
+void            initrwlock(struct rwlock*, char*);
+void            releaseread(struct rwlock*);
+void            releasewrite(struct rwlock*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -161,6 +229,8 @@ void            timerinit(void);
 
 // trap.c
 void            idtinit(void);
+void            sysenterinit(void);
+extern int      sysenterok;
 extern uint     ticks;
 void            tvinit(void);
 extern struct spinlock tickslock;
@@ -170,6 +240,11 @@ void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
 
+// vdata.c
+extern struct vdata *vdata;
+void            vdatainit(void);
+void            vdatatick(void);
+
 // vm.c
 void            seginit(void);
 void            kvmalloc(void);
@@ -185,6 +260,7 @@ void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             mapvdata(pde_t*, struct proc*);
 int             mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm);
 pte_t*          walkpgdir(pde_t *pgdir, const void *va, int alloc);
 
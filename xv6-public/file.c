@@ -5,10 +5,12 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "stat.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "uio.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -92,6 +94,38 @@ filestat(struct file *f, struct stat *st)
   return -1;
 }
 
+// Called by fileread() after it has read n bytes at f->off.
+// If reads of f are sequential, grow the read-ahead window
+// (doubling, up to RAMAX blocks) and start reading the blocks
+// in it that have not been requested yet.
+// Caller must hold f->ip->lock.
+static void
+readahead(struct file *f, int n)
+{
+  uint bn, end;
+
+  if(f->ip->type != T_FILE)
+    return;
+  if(f->off != f->ranext){
+    // A seek or an interleaved write: start over.
+    f->rawin = 0;
+    f->raend = 0;
+  } else if(f->rawin < RAMAX)
+    f->rawin = f->rawin ? min(2*f->rawin, RAMAX) : 2;
+  f->ranext = f->off + n;
+
+  if(f->rawin == 0)
+    return;
+  bn = f->ranext / BSIZE;
+  end = bn + f->rawin;
+  if(f->raend < bn)
+    f->raend = bn;
+  if(f->raend < end){
+    ireadahead(f->ip, f->raend, end - f->raend);
+    f->raend = end;
+  }
+}
+
 // Read from file f.
 int
 fileread(struct file *f, char *addr, int n)
@@ -104,54 +138,213 @@ fileread(struct file *f, char *addr, int n)
     return piperead(f->pipe, addr, n);
   if(f->type == FD_INODE){
     ilock(f->ip);
-    if((r = readi(f->ip, addr, f->off, n)) > 0)
+    if((r = readi(f->ip, addr, f->off, n)) > 0){
+      readahead(f, r);
       f->off += r;
+    }
     iunlock(f->ip);
     return r;
   }
   panic("fileread");
 }
 
+// Read from file f into the iovcnt buffers in iov, filling
+// each before the next. With off 0, read at f's offset and
+// advance it; otherwise read at *off, which only an inode
+// allows, and leave f's offset and read-ahead state alone.
+// A pipe waits only for the first byte, like piperead().
+int
+filereadv(struct file *f, struct iovec *iov, int iovcnt, uint *off)
+{
+  char *src;
+  int i, m, r, tot;
+  uint o;
+
+  if(f->readable == 0)
+    return -1;
+  tot = 0;
+  if(f->type == FD_PIPE){
+    if(off)
+      return -1;
+    for(i = 0; i < iovcnt; i++){
+      for(r = 0; r < iov[i].iov_len; r += m){
+        m = pipebeginread(f->pipe, &src, iov[i].iov_len - r, tot == 0);
+        if(m <= 0)
+          return tot > 0 ? tot : m;
+        memmove((char*)iov[i].iov_base + r, src, m);
+        pipeendread(f->pipe, m);
+        tot += m;
+      }
+    }
+    return tot;
+  }
+  if(f->type == FD_INODE){
+    ilock(f->ip);
+    for(i = 0; i < iovcnt; i++){
+      o = off ? *off : f->off;
+      // readi rejects an offset past the end; read nothing, as at EOF.
+      if(f->ip->type != T_DEV && o >= f->ip->size)
+        break;
+      r = readi(f->ip, iov[i].iov_base, o, iov[i].iov_len);
+      if(r < 0){
+        if(tot == 0)
+          tot = -1;
+        break;
+      }
+      if(off)
+        *off += r;
+      else if(r > 0){
+        readahead(f, r);
+        f->off += r;
+      }
+      tot += r;
+      if(r < iov[i].iov_len)
+        break;
+    }
+    iunlock(f->ip);
+    return tot;
+  }
+  panic("filereadv");
+}
+
 //PAGEBREAK!
+// Write the iovcnt buffers in iov to f's inode, one after the
+// other, at *off, advancing it.
+// The buffers land in one contiguous range of the file, so
+// each log transaction can take as many bytes as a single
+// write would, however they are split among the buffers: a
+// few blocks at a time to avoid exceeding the maximum log
+// transaction size, including i-node, indirect block,
+// allocation blocks, and 2 blocks of slop for non-aligned
+// writes. this really belongs lower down, since writei()
+// might be writing a device like the console.
+static int
+iwritev(struct file *f, struct iovec *iov, int iovcnt, uint *off)
+{
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  int i, pos, n, n1, r, tot, want;
+
+  want = 0;
+  for(i = 0; i < iovcnt; i++)
+    want += iov[i].iov_len;
+
+  i = pos = tot = 0;
+  r = 0;
+  while(tot < want){
+    begin_op();
+    ilock(f->ip);
+    for(n = 0; n < max && tot < want; ){
+      while(pos == iov[i].iov_len){
+        i++;
+        pos = 0;
+      }
+      n1 = iov[i].iov_len - pos;
+      if(n1 > max - n)
+        n1 = max - n;
+      if((r = writei(f->ip, (char*)iov[i].iov_base + pos, *off, n1)) > 0)
+        *off += r;
+      if(r < 0)
+        break;
+      if(r != n1)
+        panic("short filewrite");
+      pos += r;
+      n += r;
+      tot += r;
+    }
+    iunlock(f->ip);
+    end_op();
+
+    if(r < 0)
+      break;
+  }
+  return tot == want ? want : -1;
+}
+
 // Write to file f.
 int
 filewrite(struct file *f, char *addr, int n)
 {
-  int r;
+  struct iovec iov;
 
   if(f->writable == 0)
     return -1;
   if(f->type == FD_PIPE)
     return pipewrite(f->pipe, addr, n);
   if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
+    iov.iov_base = addr;
+    iov.iov_len = n;
+    return iwritev(f, &iov, 1, &f->off);
+  }
+  panic("filewrite");
+}
 
-      if(r < 0)
+// Write the iovcnt buffers in iov to file f, one after the
+// other. With off 0, write at f's offset and advance it;
+// otherwise write at *off, which only an inode allows.
+int
+filewritev(struct file *f, struct iovec *iov, int iovcnt, uint *off)
+{
+  int i, tot;
+
+  if(f->writable == 0)
+    return -1;
+  if(f->type == FD_PIPE){
+    if(off)
+      return -1;
+    tot = 0;
+    for(i = 0; i < iovcnt; i++){
+      if(pipewrite(f->pipe, iov[i].iov_base, iov[i].iov_len) < 0)
+        return -1;
+      tot += iov[i].iov_len;
+    }
+    return tot;
+  }
+  if(f->type == FD_INODE)
+    return iwritev(f, iov, iovcnt, off ? off : &f->off);
+  panic("filewritev");
+}
+
+//PAGEBREAK!
+// Move up to n bytes from in to out without copying them
+// through user memory; one of the two must be a pipe.
+// From a file, the bytes are read straight into the pipe's
+// buffer until n have moved or the file ends. From a pipe,
+// the bytes are written straight out of its buffer; like
+// read(), this waits only until some data is there.
+// Returns the number of bytes moved, 0 at end of file.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  char *addr;
+  int m, r, tot;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(in->type == FD_PIPE){
+    if(out->type == FD_PIPE && out->pipe == in->pipe)
+      return -1;
+    m = 0;
+    for(tot = 0; tot < n; tot += m){
+      if((m = pipebeginread(in->pipe, &addr, n - tot, tot == 0)) <= 0)
         break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
+      r = filewrite(out, addr, m);
+      pipeendread(in->pipe, r < 0 ? 0 : r);
+      if(r != m)
+        return tot > 0 ? tot : -1;
     }
-    return i == n ? n : -1;
+    return tot > 0 ? tot : m;
   }
-  panic("filewrite");
+  if(in->type == FD_INODE && out->type == FD_PIPE){
+    for(tot = 0; tot < n; tot += r){
+      if((m = pipebeginwrite(out->pipe, &addr, n - tot)) < 0)
+        return tot > 0 ? tot : -1;
+      r = fileread(in, addr, m);
+      pipeendwrite(out->pipe, r < 0 ? 0 : r);
+      if(r <= 0)
+        return tot > 0 ? tot : r;
+    }
+    return tot;
+  }
+  return -1;
 }
 
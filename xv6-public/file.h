@@ -6,6 +6,9 @@ struct file {
   struct pipe *pipe;
   struct inode *ip;
   uint off;
+  uint ranext;  // off after the last read, to detect sequential reads
+  uint rawin;   // read-ahead window in blocks; 0 if not sequential
+  uint raend;   // first block not yet read ahead
 };
 
 
@@ -14,6 +17,9 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *hnext; // icache hash chain or free list
+  struct inode *lprev; // icache LRU list, while ref is 0
+  struct inode *lnext;
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -22,7 +28,8 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+2];
+  uint lastblock;     // last block bmap() allocated, a goal for the next
 };
 
 // table mapping major device number to
@@ -27,6 +27,19 @@ static void itrunc(struct inode*);
 // only one device
 struct superblock sb; 
 
+#define NBMAP (FSSIZE/BPB + 1)  // max bitmap blocks
+
+// In-memory allocation summary, kept in step with the bitmap
+// and inode blocks in the buffer cache. nfree[] counts the free
+// blocks each bitmap block describes, so that balloc() can skip
+// full ones. ialloc() starts looking for a free inode at inohint,
+// the lowest i-number that may be free.
+static struct {
+  struct spinlock lock;
+  uint nfree[NBMAP];
+  uint inohint;
+} fsalloc;
+
 // Read the super block.
 void
 readsb(int dev, struct superblock *sb)
@@ -38,38 +51,86 @@ readsb(int dev, struct superblock *sb)
   brelse(bp);
 }
 
-// Zero a block.
+// Zero a block. A file data block is written in
+// ordered mode rather than through the log.
 static void
-bzero(int dev, int bno)
+bzero(int dev, int bno, int isdata)
 {
   struct buf *bp;
 
-  bp = bread(dev, bno);
-  memset(bp->data, 0, BSIZE);
-  log_write(bp);
+  bp = bzeroed(dev, bno);
+  if(isdata)
+    log_data(bp);
+  else
+    log_write(bp);
   brelse(bp);
 }
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// Count the free blocks described by each bitmap block.
+// Called after initlog(), so that bitmap blocks replayed by
+// log recovery are counted as they are on disk now.
+void
+bsummary(int dev)
+{
+  uint k, bi, nfree;
+  struct buf *bp;
+
+  if(sb.size > NBMAP*BPB)
+    panic("bsummary: file system larger than FSSIZE");
+  for(k = 0; k*BPB < sb.size; k++){
+    bp = bread(dev, sb.bmapstart + k);
+    nfree = 0;
+    for(bi = 0; bi < BPB && k*BPB + bi < sb.size; bi++)
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0)
+        nfree++;
+    brelse(bp);
+    fsalloc.nfree[k] = nfree;
+  }
+}
+
+// Allocate a zeroed disk block: the first free block at or
+// after goal, wrapping around, so that a file's blocks stay
+// contiguous when they can. Bitmap blocks with no free blocks
+// are not read, and full bytes of the bitmap are skipped.
+// File data blocks (isdata) are written outside the log, so
+// they must not reuse a block the log still holds: recovery
+// would replay the old contents over the data.
 static uint
-balloc(uint dev)
+balloc(uint dev, uint goal, int isdata)
 {
-  int b, bi, m;
+  uint n, nb, k, bi, end, b, m;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+  if(goal >= sb.size)
+    goal = 0;
+  nb = (sb.size + BPB - 1) / BPB;
+  // Visit goal's bitmap block first from goal on, then the
+  // others, then goal's block again up to goal.
+  for(n = 0; n <= nb; n++){
+    k = (goal/BPB + n) % nb;
+    if(fsalloc.nfree[k] == 0)
+      continue;
+    bi = n == 0 ? goal % BPB : 0;
+    end = n == nb ? goal % BPB : BPB;
+    bp = bread(dev, sb.bmapstart + k);
+    for(; bi < end && k*BPB + bi < sb.size; bi++){
+      if(bi % 8 == 0 && bp->data[bi/8] == 0xff){
+        bi += 7;
+        continue;
+      }
+      b = k*BPB + bi;
       m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
+      if((bp->data[bi/8] & m) == 0 && !(isdata && log_inuse(b))){
         bp->data[bi/8] |= m;  // Mark block in use.
         log_write(bp);
+        acquire(&fsalloc.lock);
+        fsalloc.nfree[k]--;
+        release(&fsalloc.lock);
         brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
+        bzero(dev, b, isdata);
+        return b;
       }
     }
     brelse(bp);
@@ -91,6 +152,9 @@ bfree(int dev, uint b)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
+  acquire(&fsalloc.lock);
+  fsalloc.nfree[b / BPB]++;
+  release(&fsalloc.lock);
   brelse(bp);
 }
 
@@ -119,18 +183,18 @@ bfree(int dev, uint b)
 //   is non-zero. ialloc() allocates, and iput() frees if
 //   the reference and link counts have fallen to zero.
 //
-// * Referencing in cache: an entry in the inode cache
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() finds or
-//   creates a cache entry and increments its ref; iput()
-//   decrements ref.
+// * Referencing in cache: ip->ref tracks the number of
+//   in-memory pointers to a cache entry (open files and
+//   current directories). iget() finds or creates a cache
+//   entry and increments its ref; iput() decrements ref.
+//   An entry whose ref is zero stays cached, contents and
+//   all, until iget() recycles it for another inode.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   cache entry is only correct when ip->valid is 1.
 //   ilock() reads the inode from
 //   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ip->valid when it frees the inode.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -154,35 +218,86 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// Entries are hashed by (dev, inum) into NIBUCKET chains, each
+// with its own lock, like the buffer cache. A bucket lock
+// protects its chain and the ref of the entries on it; since
+// ip->dev and ip->inum say which chain an entry is on, they
+// change only while the entry is off every chain.
+// icache.lock serializes the insertion of new entries: it
+// protects the free list and is held while choosing an entry
+// to recycle.
+//
+// The entries with ref 0 are on an LRU list, most recently
+// released first, protected by icache.lrulock. An entry is put on
+// it when its ref drops to 0 and taken off when it rises again,
+// with its bucket lock held, so a cached entry is on the list
+// exactly when its ref is 0. Locks are taken in the order
+// icache.lock, bucket lock, icache.lrulock.
+//
+// The cache starts with NINODE static entries and grows a page
+// of entries at a time, up to 1/ICACHEFRAC of physical memory,
+// as long as at least a quarter of memory is still free. Once
+// it cannot grow, the entry at the tail of the LRU list is
+// recycled.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
+// the LRU links, dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIBUCKET   61  // number of hash chains; prime
+#define ICACHEFRAC 64  // cache may use 1/ICACHEFRAC of memory
+#define IPP (PGSIZE/sizeof(struct inode))  // inodes per page
+
+#define IHASH(dev, inum) (((dev)*31 + (inum)) % NIBUCKET)
+
+struct ibucket {
+  struct spinlock lock;
+  struct inode *head;   // Hash chain, through hnext
+  uint hits;            // Lookups that found the inode cached
+  uint misses;          // Lookups that had to take a new entry
+};
+
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
+  struct ibucket bucket[NIBUCKET];
+
+  struct inode *free;   // Entries never yet used, through hnext
+  struct spinlock lrulock;
+  struct inode *lru;    // Entries with ref 0, most recent first
+  struct inode *lrutail;
+  int ninode;           // Entries allocated so far
+  int npage;            // Pages allocated for entries
+  uint evictions;       // Entries recycled for another inode
 } icache;
 
 void
 iinit(int dev)
 {
-  int i = 0;
-  
+  struct inode *ip;
+  struct ibucket *bk;
+
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
+  initlock(&icache.lrulock, "icache.lru");
+  for(bk = icache.bucket; bk < icache.bucket+NIBUCKET; bk++)
+    initlock(&bk->lock, "icache.bucket");
+  for(ip = icache.inode; ip < icache.inode+NINODE; ip++){
+    initsleeplock(&ip->lock, "inode");
+    ip->hnext = icache.free;
+    icache.free = ip;
   }
+  icache.ninode = NINODE;
 
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
- inodestart %d bmap start %d\n", sb.size, sb.nblocks,
+ inodestart %d bmap start %d bsize %d\n", sb.size, sb.nblocks,
           sb.ninodes, sb.nlog, sb.logstart, sb.inodestart,
-          sb.bmapstart);
+          sb.bmapstart, sb.bsize);
+  if(sb.bsize != BSIZE)
+    panic("iinit: file system block size is not BSIZE");
+
+  initlock(&fsalloc.lock, "fsalloc");
+  fsalloc.inohint = 1;
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -191,14 +306,22 @@ static struct inode* iget(uint dev, uint inum);
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
 // Returns an unlocked but allocated and referenced inode.
+// The search starts at fsalloc.inohint; it wraps around in
+// case an inode below it was freed while the search ran.
 struct inode*
 ialloc(uint dev, short type)
 {
-  int inum;
+  uint i, start, inum;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
+  acquire(&fsalloc.lock);
+  start = fsalloc.inohint;
+  release(&fsalloc.lock);
+  for(i = 0; i < sb.ninodes; i++){
+    inum = (start + i) % sb.ninodes;
+    if(inum == 0)
+      continue;
     bp = bread(dev, IBLOCK(inum, sb));
     dip = (struct dinode*)bp->data + inum%IPB;
     if(dip->type == 0){  // a free inode
@@ -206,6 +329,10 @@ ialloc(uint dev, short type)
       dip->type = type;
       log_write(bp);   // mark it allocated on the disk
       brelse(bp);
+      acquire(&fsalloc.lock);
+      if(fsalloc.inohint == start && inum >= start)
+        fsalloc.inohint = inum + 1;
+      release(&fsalloc.lock);
       return iget(dev, inum);
     }
     brelse(bp);
@@ -235,37 +362,168 @@ iupdate(struct inode *ip)
   brelse(bp);
 }
 
+// Add a page of fresh entries to the free list, if the
+// cache is allowed to grow. Caller must hold icache.lock.
+static void
+igrow(void)
+{
+  struct inode *ip;
+  char *mem;
+  int i;
+
+  if(icache.npage >= ktotalpages() / ICACHEFRAC ||
+     kfreepages() < ktotalpages() / 4)
+    return;
+  if((mem = kalloc()) == 0)
+    return;
+  memset(mem, 0, PGSIZE);
+  for(i = 0; i < IPP; i++){
+    ip = (struct inode*)mem + i;
+    initsleeplock(&ip->lock, "inode");
+    ip->hnext = icache.free;
+    icache.free = ip;
+  }
+  icache.npage++;
+  icache.ninode += IPP;
+}
+
+// Put ip, whose ref has just dropped to 0, at the head of
+// the LRU list. Caller must hold ip's bucket lock.
+static void
+lruadd(struct inode *ip)
+{
+  acquire(&icache.lrulock);
+  ip->lprev = 0;
+  ip->lnext = icache.lru;
+  if(icache.lru)
+    icache.lru->lprev = ip;
+  else
+    icache.lrutail = ip;
+  icache.lru = ip;
+  release(&icache.lrulock);
+}
+
+// Take ip, whose ref is 0, off the LRU list.
+// Caller must hold ip's bucket lock.
+static void
+lrudel(struct inode *ip)
+{
+  acquire(&icache.lrulock);
+  if(ip->lprev)
+    ip->lprev->lnext = ip->lnext;
+  else
+    icache.lru = ip->lnext;
+  if(ip->lnext)
+    ip->lnext->lprev = ip->lprev;
+  else
+    icache.lrutail = ip->lprev;
+  release(&icache.lrulock);
+}
+
+// Unhash and return the least recently released entry
+// that nobody is using, or 0 if there is none.
+// Caller must hold icache.lock, so that no other process
+// unhashes entries or changes their dev and inum.
+static struct inode*
+ievict(void)
+{
+  struct ibucket *bk;
+  struct inode *ip, **pp;
+
+  for(;;){
+    acquire(&icache.lrulock);
+    ip = icache.lrutail;
+    release(&icache.lrulock);
+    if(ip == 0)
+      return 0;
+    bk = &icache.bucket[IHASH(ip->dev, ip->inum)];
+    acquire(&bk->lock);
+    // Someone may have taken it while we were not holding
+    // the bucket lock; then try the new tail.
+    if(ip->ref == 0)
+      break;
+    release(&bk->lock);
+  }
+
+  lrudel(ip);
+  for(pp = &bk->head; *pp != ip; pp = &(*pp)->hnext)
+    ;
+  *pp = ip->hnext;
+  release(&bk->lock);
+  icache.evictions++;
+  return ip;
+}
+
+// Return the entry for inode inum on device dev in
+// bucket bk, or 0 if it is not cached.
+// Caller must hold bk->lock.
+static struct inode*
+ifind(struct ibucket *bk, uint dev, uint inum)
+{
+  struct inode *ip;
+
+  for(ip = bk->head; ip; ip = ip->hnext)
+    if(ip->dev == dev && ip->inum == inum)
+      return ip;
+  return 0;
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct ibucket *bk;
+  struct inode *ip;
 
-  acquire(&icache.lock);
+  bk = &icache.bucket[IHASH(dev, inum)];
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&icache.lock);
-      return ip;
-    }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+  acquire(&bk->lock);
+  if((ip = ifind(bk, dev, inum)) != 0){
+    if(ip->ref++ == 0)
+      lrudel(ip);
+    bk->hits++;
+    release(&bk->lock);
+    return ip;
   }
+  release(&bk->lock);
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
+  // Not cached. Only one process at a time inserts inodes;
+  // look again once we are that process, in case another
+  // one cached the inode in the meantime.
+  acquire(&icache.lock);
+  acquire(&bk->lock);
+  if((ip = ifind(bk, dev, inum)) != 0){
+    if(ip->ref++ == 0)
+      lrudel(ip);
+    bk->hits++;
+    release(&bk->lock);
+    release(&icache.lock);
+    return ip;
+  }
+  bk->misses++;
+  release(&bk->lock);
+
+  // Take a fresh entry if the cache may grow,
+  // otherwise recycle an unused one.
+  if(icache.free == 0)
+    igrow();
+  if((ip = icache.free) != 0)
+    icache.free = ip->hnext;
+  else if((ip = ievict()) == 0)
     panic("iget: no inodes");
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->lastblock = 0;
+  acquire(&bk->lock);
+  ip->hnext = bk->head;
+  bk->head = ip;
+  release(&bk->lock);
   release(&icache.lock);
 
   return ip;
@@ -276,9 +534,13 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
-  ip->ref++;
-  release(&icache.lock);
+  struct ibucket *bk;
+
+  bk = &icache.bucket[IHASH(ip->dev, ip->inum)];
+  acquire(&bk->lock);
+  if(ip->ref++ == 0)
+    lrudel(ip);
+  release(&bk->lock);
   return ip;
 }
 
@@ -331,23 +593,58 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
+  struct ibucket *bk;
+
+  bk = &icache.bucket[IHASH(ip->dev, ip->inum)];
   acquiresleep(&ip->lock);
   if(ip->valid && ip->nlink == 0){
-    acquire(&icache.lock);
+    acquire(&bk->lock);
     int r = ip->ref;
-    release(&icache.lock);
+    release(&bk->lock);
     if(r == 1){
       // inode has no links and no other references: truncate and free.
+      if(ip->type == T_DIR)
+        dcachepurge(ip->dev, ip->inum);
       itrunc(ip);
       ip->type = 0;
       iupdate(ip);
       ip->valid = 0;
+      acquire(&fsalloc.lock);
+      if(ip->inum < fsalloc.inohint)
+        fsalloc.inohint = ip->inum;
+      release(&fsalloc.lock);
     }
   }
   releasesleep(&ip->lock);
 
+  acquire(&bk->lock);
+  if(--ip->ref == 0)
+    lruadd(ip);
+  release(&bk->lock);
+}
+
+// Print inode cache statistics, then zero the
+// counters if reset is set.
+void
+istat(int reset)
+{
+  struct ibucket *bk;
+  uint hits, misses;
+
+  hits = misses = 0;
+  for(bk = icache.bucket; bk < icache.bucket+NIBUCKET; bk++){
+    acquire(&bk->lock);
+    hits += bk->hits;
+    misses += bk->misses;
+    if(reset)
+      bk->hits = bk->misses = 0;
+    release(&bk->lock);
+  }
   acquire(&icache.lock);
-  ip->ref--;
+  cprintf("icache: %d inodes, %d hits, %d misses, %d evictions\n",
+          icache.ninode, hits, misses, icache.evictions);
+  if(reset)
+    icache.evictions = 0;
   release(&icache.lock);
 }
 
@@ -365,19 +662,53 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT]. The next NDINDIRECT
+// blocks are listed in the indirect blocks listed in the
+// double-indirect block ip->addrs[NDIRECT+1].
+
+// Allocate a block for ip, preferably right after prev, the
+// block before it in the file or the indirect block above it,
+// or else after the last block allocated for ip.
+static uint
+bmalloc(struct inode *ip, uint prev, int isdata)
+{
+  uint goal;
+
+  goal = prev ? prev + 1 : (ip->lastblock ? ip->lastblock + 1 : 0);
+  ip->lastblock = balloc(ip->dev, goal, isdata);
+  return ip->lastblock;
+}
+
+// Return entry i of indirect block ind, allocating a block
+// for it if there is none.
+static uint
+bmapind(struct inode *ip, uint ind, uint i, int isdata)
+{
+  uint addr, *a;
+  struct buf *bp;
+
+  bp = bread(ip->dev, ind);
+  a = (uint*)bp->data;
+  if((addr = a[i]) == 0){
+    a[i] = addr = bmalloc(ip, i > 0 ? a[i-1] : ind, isdata);
+    log_write(bp);
+  }
+  brelse(bp);
+  return addr;
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
 static uint
 bmap(struct inode *ip, uint bn)
 {
-  uint addr, *a;
-  struct buf *bp;
+  uint addr;
+  int isdata;
 
+  isdata = ip->type == T_FILE;
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = bmalloc(ip, bn > 0 ? ip->addrs[bn-1] : 0, isdata);
     return addr;
   }
   bn -= NDIRECT;
@@ -385,15 +716,18 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
-      log_write(bp);
-    }
-    brelse(bp);
-    return addr;
+      ip->addrs[NDIRECT] = addr = bmalloc(ip, ip->addrs[NDIRECT-1], 0);
+    return bmapind(ip, addr, bn, isdata);
+  }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    // Load double-indirect block, allocating if necessary,
+    // then the indirect block under it.
+    if((addr = ip->addrs[NDIRECT+1]) == 0)
+      ip->addrs[NDIRECT+1] = addr = bmalloc(ip, ip->addrs[NDIRECT], 0);
+    addr = bmapind(ip, addr, bn / NINDIRECT, 0);
+    return bmapind(ip, addr, bn % NINDIRECT, isdata);
   }
 
   panic("bmap: out of range");
@@ -408,8 +742,8 @@ static void
 itrunc(struct inode *ip)
 {
   int i, j;
-  struct buf *bp;
-  uint *a;
+  struct buf *bp, *dbp;
+  uint *a, *da;
 
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
@@ -430,10 +764,48 @@ itrunc(struct inode *ip)
     ip->addrs[NDIRECT] = 0;
   }
 
+  if(ip->addrs[NDIRECT+1]){
+    dbp = bread(ip->dev, ip->addrs[NDIRECT+1]);
+    da = (uint*)dbp->data;
+    for(i = 0; i < NINDIRECT; i++){
+      if(da[i] == 0)
+        continue;
+      bp = bread(ip->dev, da[i]);
+      a = (uint*)bp->data;
+      for(j = 0; j < NINDIRECT; j++){
+        if(a[j])
+          bfree(ip->dev, a[j]);
+      }
+      brelse(bp);
+      bfree(ip->dev, da[i]);
+    }
+    brelse(dbp);
+    bfree(ip->dev, ip->addrs[NDIRECT+1]);
+    ip->addrs[NDIRECT+1] = 0;
+  }
+
   ip->size = 0;
   iupdate(ip);
 }
 
+// Start asynchronous reads of up to n blocks of ip's
+// content beginning with block bn, stopping at the end
+// of the file. Caller must hold ip->lock.
+void
+ireadahead(struct inode *ip, uint bn, uint n)
+{
+  uint end;
+
+  end = (ip->size + BSIZE - 1) / BSIZE;
+  if(end > MAXFILE)
+    end = MAXFILE;
+  for(; n > 0 && bn < end; bn++, n--){
+    // Every block below ip->size is allocated, so
+    // this bmap() never needs to allocate.
+    breadahead(ip->dev, bmap(ip, bn));
+  }
+}
+
 // Copy stat information from inode.
 // Caller must hold ip->lock.
 void
@@ -492,14 +864,17 @@ writei(struct inode *ip, char *src, uint off, uint n)
 
   if(off > ip->size || off + n < off)
     return -1;
-  if(off + n > MAXFILE*BSIZE)
+  if((uint64)off + n > (uint64)MAXFILE*BSIZE)
     return -1;
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(bp->data + off%BSIZE, src, m);
-    log_write(bp);
+    if(ip->type == T_FILE)
+      log_data(bp);
+    else
+      log_write(bp);
     brelse(bp);
   }
 
@@ -519,17 +894,233 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Read or write slot i of hashed directory dp's header.
+static void
+dirhdrio(struct inode *dp, uint i, struct dirhdr *h, int write)
+{
+  uint off;
+
+  off = i * sizeof(*h);
+  if(write){
+    if(writei(dp, (char*)h, off, sizeof(*h)) != sizeof(*h))
+      panic("dirhdrio write");
+  } else if(readi(dp, (char*)h, off, sizeof(*h)) != sizeof(*h))
+    panic("dirhdrio read");
+}
+
+// Index of name's bucket pointer in hashed directory dp's header.
+static uint
+hdirbucket(struct inode *dp, char *name)
+{
+  struct dirhdr h;
+
+  dirhdrio(dp, 0, &h, 0);
+  return dirhash(name) & ((1 << dirdepth(h.depth)) - 1);
+}
+
+// Search name's bucket in hashed directory dp. If found,
+// return its i-number and set *poff. Otherwise return 0 and set
+// *pfree to the offset of a free slot in the chain (0 if none)
+// and *plast to the chain's last block (0 if the bucket is empty).
+static uint
+hdirscan(struct inode *dp, char *name, uint *poff, uint *pfree, uint *plast)
+{
+  struct dirhdr h;
+  struct dirent *de;
+  struct buf *bp;
+  uint b, fbn, i, inum;
+
+  b = hdirbucket(dp, name);
+  dirhdrio(dp, b / 3, &h, 0);
+  *pfree = *plast = 0;
+  bp = 0;
+  for(fbn = h.blk[b % 3]; fbn != 0; fbn = ((struct dirhdr*)bp->data)->blk[0]){
+    if(fbn >= dp->size / BSIZE)
+      panic("hdirscan: bad chain");
+    if(bp)
+      brelse(bp);
+    bp = bread(dp->dev, bmap(dp, fbn));
+    de = (struct dirent*)bp->data;
+    for(i = 1; i < DPB; i++){
+      if(de[i].inum == 0){
+        if(*pfree == 0)
+          *pfree = fbn*BSIZE + i*sizeof(*de);
+      } else if(namecmp(name, de[i].name) == 0){
+        *poff = fbn*BSIZE + i*sizeof(*de);
+        inum = de[i].inum;
+        brelse(bp);
+        return inum;
+      }
+    }
+    *plast = fbn;
+  }
+  if(bp)
+    brelse(bp);
+  return 0;
+}
+
+// Split full bucket block fbn of hashed directory dp in two,
+// moving the names whose next hash bit is set to a new block and
+// doubling the header's pointers if the bucket is as deep as the
+// table. Return 0, changing nothing, if the header has no room
+// for more buckets or if the split would leave no room for name.
+// Moved names change offset, so dp's dcache entries are dropped.
+static int
+hdirsplit(struct inode *dp, uint fbn, char *name)
+{
+  static char zero[BSIZE];
+  struct buf *hp, *op, *np;
+  struct dirhdr x, *h, *ob, *nb;
+  struct dirent *ode, *nde;
+  uint g, d, k, i, j, nfbn, bit;
+
+  dirhdrio(dp, 0, &x, 0);
+  g = dirdepth(x.depth);
+  if(readi(dp, (char*)&x, fbn*BSIZE, sizeof(x)) != sizeof(x))
+    panic("hdirsplit read");
+  d = dirdepth(x.depth);
+  if(d == g && (2 << g) > NDIRBUCKET)
+    return 0;
+  op = bread(dp->dev, bmap(dp, fbn));
+  ode = (struct dirent*)op->data;
+  bit = (dirhash(name) >> d) & 1;
+  for(i = 1; i < DPB; i++)
+    if(ode[i].inum == 0 || ((dirhash(ode[i].name) >> d) & 1) != bit)
+      break;
+  brelse(op);
+  if(i == DPB)
+    return 0;
+
+  nfbn = dp->size / BSIZE;
+  if(writei(dp, zero, dp->size, BSIZE) != BSIZE)
+    panic("hdirsplit grow");
+
+  hp = bread(dp->dev, bmap(dp, 0));
+  op = bread(dp->dev, bmap(dp, fbn));
+  np = bread(dp->dev, bmap(dp, nfbn));
+  h = (struct dirhdr*)hp->data;
+  ob = (struct dirhdr*)op->data;
+  nb = (struct dirhdr*)np->data;
+  if(d == g){
+    for(k = 0; k < (1 << g); k++)
+      h[(k + (1 << g)) / 3].blk[(k + (1 << g)) % 3] = h[k / 3].blk[k % 3];
+    g++;
+    h[0].depth = g + 1;
+  }
+  for(k = 0; k < (1 << g); k++)
+    if(h[k / 3].blk[k % 3] == fbn && (k >> d) & 1)
+      h[k / 3].blk[k % 3] = nfbn;
+
+  ode = (struct dirent*)op->data;
+  nde = (struct dirent*)np->data;
+  for(i = j = 1; i < DPB; i++){
+    if(ode[i].inum != 0 && (dirhash(ode[i].name) >> d) & 1){
+      nde[j++] = ode[i];
+      memset(&ode[i], 0, sizeof(ode[i]));
+    }
+  }
+  ob->depth = nb->depth = d + 2;
+
+  log_write(hp);
+  log_write(op);
+  log_write(np);
+  brelse(hp);
+  brelse(op);
+  brelse(np);
+  dcachepurge(dp->dev, dp->inum);
+  return 1;
+}
+
+// Find a free slot for name in hashed directory dp and return
+// its offset. A full bucket of one block is split if that makes
+// room for name; otherwise a block is added to the bucket's chain.
+// Creates the header of an empty directory.
+//
+// Either way dirlink() makes at most one such change, so that
+// mkdir in a large directory logs at most 11 blocks: the two
+// inodes, two bitmap blocks, the new directory's header and
+// bucket, dp's header, its full bucket and its new block, and
+// two indirect blocks mapping that block (see MAXOPBLOCKS).
+static uint
+hdirslot(struct inode *dp, char *name)
+{
+  static char zero[BSIZE];
+  struct dirhdr h, lh;
+  uint off, free, last, b, fbn;
+
+  if(dp->size == 0){
+    memset(&h, 0, sizeof(h));
+    h.depth = 1;  // one bucket
+    if(writei(dp, zero, 0, BSIZE) != BSIZE)
+      panic("hdirslot header");
+    dirhdrio(dp, 0, &h, 1);
+  }
+  if(hdirscan(dp, name, &off, &free, &last) != 0)
+    panic("hdirslot: name present");
+  if(free)
+    return free;
+  b = hdirbucket(dp, name);
+  dirhdrio(dp, b / 3, &h, 0);
+  if(last != 0 && h.blk[b % 3] == last && hdirsplit(dp, last, name)){
+    hdirscan(dp, name, &off, &free, &last);
+    if(free == 0)
+      panic("hdirslot split");
+    return free;
+  }
+
+  // Append a block: a new bucket, or the end of a full chain.
+  fbn = dp->size / BSIZE;
+  if(writei(dp, zero, dp->size, BSIZE) != BSIZE)
+    panic("hdirslot grow");
+  if(last == 0){
+    h.blk[b % 3] = fbn;
+    dirhdrio(dp, b / 3, &h, 1);
+    dirhdrio(dp, 0, &h, 0);
+    memset(&lh, 0, sizeof(lh));
+    lh.depth = h.depth;
+    last = fbn;
+  } else {
+    if(readi(dp, (char*)&lh, last*BSIZE, sizeof(lh)) != sizeof(lh))
+      panic("hdirslot read");
+    lh.blk[0] = fbn;
+  }
+  if(writei(dp, (char*)&lh, last*BSIZE, sizeof(lh)) != sizeof(lh))
+    panic("hdirslot link");
+  return fbn*BSIZE + sizeof(struct dirent);
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// The directory is searched only if the dcache does not
+// know the answer; the result is then cached.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
+  uint off, inum, free, last;
   struct dirent de;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
+  if(dcachelookup(dp->dev, dp->inum, name, &inum, &off)){
+    if(inum == 0)
+      return 0;
+    if(poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  }
+
+  if((dp->major & DIRHASHED) && dp->size > 0){
+    if((inum = hdirscan(dp, name, &off, &free, &last)) != 0){
+      if(poff)
+        *poff = off;
+      dcacheenter(dp->dev, dp->inum, name, inum, off);
+      return iget(dp->dev, inum);
+    }
+    dcacheenter(dp->dev, dp->inum, name, 0, 0);
+    return 0;
+  }
+
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
@@ -540,10 +1131,12 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       if(poff)
         *poff = off;
       inum = de.inum;
+      dcacheenter(dp->dev, dp->inum, name, inum, off);
       return iget(dp->dev, inum);
     }
   }
 
+  dcacheenter(dp->dev, dp->inum, name, 0, 0);
   return 0;
 }
 
@@ -562,7 +1155,9 @@ dirlink(struct inode *dp, char *name, uint inum)
   }
 
   // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
+  if(dp->major & DIRHASHED)
+    off = hdirslot(dp, name);
+  else for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlink read");
     if(de.inum == 0)
@@ -573,6 +1168,7 @@ dirlink(struct inode *dp, char *name, uint inum)
   de.inum = inum;
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcacheenter(dp->dev, dp->inum, name, inum, off);
 
   return 0;
 }
@@ -3,7 +3,12 @@
 
 
 #define ROOTINO 1  // root i-number
-#define BSIZE 512  // block size
+#ifndef BSIZE
+#define BSIZE 512  // block size (make BSIZE=n)
+#endif
+#if BSIZE != 512 && BSIZE != 1024 && BSIZE != 2048 && BSIZE != 4096
+#error "BSIZE must be 512, 1024, 2048 or 4096"
+#endif
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
@@ -19,20 +24,26 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint bsize;        // Block size (bytes); must equal BSIZE
 };
 
-#define NDIRECT 12
+// The log header block names the blocks in the log.
+#define MAXLOG (BSIZE / sizeof(uint) - 1)
+
+#define NDIRECT 11
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT)
 
 // On-disk inode structure
 struct dinode {
   short type;           // File type
-  short major;          // Major device number (T_DEV only)
+  short major;          // Major device number (T_DEV only),
+                        // or directory flags (T_DIR)
   short minor;          // Minor device number (T_DEV only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NDIRECT+2];   // Data block addresses
 };
 
 // Inodes per block.
@@ -55,3 +66,54 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// Dirents per block
+#define DPB           (BSIZE / sizeof(struct dirent))
+
+// A directory with DIRHASHED in its major field is an extendible
+// hash table. Block 0 is a header whose dirent-sized slots each hold
+// three bucket pointers; the first 2^depth of them, indexed by the
+// low depth bits of a name's hash, point at bucket blocks. A bucket's
+// first slot records how many hash bits its names share and links to
+// an overflow block (0 ends the chain). When a bucket fills, dirlink
+// splits it on the next hash bit, doubling the pointers if need be,
+// so a lookup reads one bucket until there are NDIRBUCKET of them;
+// only then do buckets grow chains. The header and link slots have
+// inum 0, so the directory still reads as an ordinary sequence of
+// dirents. An empty directory takes two blocks: the header and the
+// bucket holding . and ..
+#define DIRHASHED 1
+
+struct dirhdr {
+  ushort zero;          // inum 0: not an entry
+  ushort depth;         // hash bits in use plus 1; see dirdepth()
+  uint blk[3];          // bucket pointers, or next block in chain
+};
+
+// Most buckets a header can point to (2*DPB of its 3*DPB slots).
+#define NDIRBUCKET (2*DPB)
+
+// Hash bits a header or bucket depth field says are in use.
+// Tables made before buckets could split have 0 there and
+// a fixed 32 buckets.
+static inline uint
+dirdepth(ushort depth)
+{
+  return depth ? depth - 1 : 5;
+}
+
+// Hash of name; its low bits pick a bucket. "." and ".."
+// hash to 0, so creating a directory fills only one bucket.
+static inline uint
+dirhash(const char *name)
+{
+  uint h;
+  int i;
+
+  if(name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+    return 0;
+  h = 2166136261U;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619U;
+  return h;
+}
+
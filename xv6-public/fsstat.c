@@ -0,0 +1,13 @@
+// Print kernel file system cache statistics.
+// With -r, also zero the counters.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  fsstat(argc > 1 && strcmp(argv[1], "-r") == 0);
+  exit();
+}
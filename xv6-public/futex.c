@@ -0,0 +1,130 @@
+// Futexes: let user processes block on a memory word.
+//
+// A waiter is queued under the physical address of the word,
+// so processes that share the page (e.g., through a MAP_SHARED
+// mapping) find the same queue even though their virtual
+// addresses differ. futexwait() checks the word and goes to
+// sleep atomically with respect to futexwake(), which hands
+// out wakeup tokens so that at most n waiters return.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define NFUTEX 64  // maximum number of words being waited on
+
+struct futexq {
+  uint key;      // Physical address of the word
+  int nwait;     // Processes waiting on the word
+  int nwake;     // Wakeups handed out but not yet taken
+};
+
+struct {
+  struct spinlock lock;
+  struct futexq q[NFUTEX];
+} futexes;
+
+void
+futexinit(void)
+{
+  initlock(&futexes.lock, "futex");
+}
+
+// Translate user address va in the current process to the
+// physical address that names its futex queue.
+// Returns 0 if va is misaligned or not mapped for the user.
+static uint
+futexkey(uint va)
+{
+  pte_t *pte;
+
+  if(va % sizeof(int) != 0 || va >= KERNBASE)
+    return 0;
+  pte = walkpgdir(myproc()->pgdir, (void*)va, 0);
+  if(pte == 0 || (*pte & PTE_P) == 0 || (*pte & PTE_U) == 0)
+    return 0;
+  return PTE_ADDR(*pte) | (va & (PGSIZE-1));
+}
+
+// Find the queue for key; allocate one if alloc is set.
+// Must hold futexes.lock.
+static struct futexq*
+futexlookup(uint key, int alloc)
+{
+  struct futexq *q, *empty;
+
+  empty = 0;
+  for(q = futexes.q; q < &futexes.q[NFUTEX]; q++){
+    if(q->nwait > 0 && q->key == key)
+      return q;
+    if(empty == 0 && q->nwait == 0)
+      empty = q;
+  }
+  if(!alloc || empty == 0)
+    return 0;
+  empty->key = key;
+  empty->nwake = 0;
+  return empty;
+}
+
+// Sleep until woken by futexwake(), provided the word
+// at va still holds val.
+// Returns 0 when woken, -1 if the word differed, va was bad,
+// too many words are being waited on, or the process was killed.
+int
+futexwait(uint va, int val)
+{
+  struct futexq *q;
+  uint key;
+  int r;
+
+  if((key = futexkey(va)) == 0)
+    return -1;
+
+  acquire(&futexes.lock);
+  if(*(int*)P2V(key) != val || (q = futexlookup(key, 1)) == 0){
+    release(&futexes.lock);
+    return -1;
+  }
+  q->nwait++;
+  while(q->nwake == 0 && !myproc()->killed)
+    sleep(q, &futexes.lock);
+  r = -1;
+  if(q->nwake > 0){
+    q->nwake--;
+    r = 0;
+  }
+  q->nwait--;
+  release(&futexes.lock);
+  return r;
+}
+
+// Wake up to n processes waiting on the word at va.
+// Returns the number of processes woken, or -1 if va was bad.
+int
+futexwake(uint va, int n)
+{
+  struct futexq *q;
+  uint key;
+  int k;
+
+  if((key = futexkey(va)) == 0)
+    return -1;
+
+  acquire(&futexes.lock);
+  k = 0;
+  if((q = futexlookup(key, 0)) != 0){
+    k = min(n, q->nwait - q->nwake);
+    if(k > 0){
+      q->nwake += k;
+      wakeup(q);
+    } else
+      k = 0;
+  }
+  release(&futexes.lock);
+  return k;
+}
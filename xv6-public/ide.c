@@ -1,4 +1,18 @@
-// Simple PIO-based (non-DMA) IDE driver code.
+// Simple IDE driver code.
+//
+// If the PCI IDE controller supports bus-master DMA (as the
+// PIIX controllers QEMU emulates do), the disk moves the data
+// to and from memory itself and interrupts once per command.
+// Otherwise, and after any DMA error, the driver falls back to
+// PIO, copying each block with insl/outsl in the interrupt
+// handler.
+//
+// Requests wait in idequeue sorted in elevator (C-LOOK) order:
+// by block number, starting from where the disk head was left
+// and wrapping around. idestart() merges a run of queued
+// requests for consecutive blocks in the same direction into
+// one multi-sector command. The disk interrupts once per block,
+// and ideintr() completes the requests of the run one by one.
 
 #include "types.h"
 #include "defs.h"
@@ -23,17 +37,57 @@
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+#define IDE_CMD_RDDMA 0xc8
+#define IDE_CMD_WRDMA 0xca
+
+// Bus-master IDE registers, relative to dmabase.
+#define BM_CMD        0       // Command
+#define BM_CMD_START  0x01    //   Start transfer
+#define BM_CMD_READ   0x08    //   Transfer to memory (disk read)
+#define BM_STATUS     2       // Status; write 1s to clear bits
+#define BM_STATUS_ERR 0x02    //   Transfer failed
+#define BM_STATUS_INT 0x04    //   Drive raised its interrupt
+#define BM_PRDT       4       // Physical address of PRD table
+
+// Physical region descriptor: one contiguous piece of a transfer.
+// A piece may not cross a 64 KB boundary.
+struct prd {
+  uint addr;
+  ushort len;
+  ushort flags;
+};
+#define PRD_EOT 0x8000        // last descriptor in the table
+
+// Most sectors one command can move: a sector count of 0
+// in the 8-bit count register means 256.
+#define IDE_MAXSECT   256
 
 // idequeue points to the buf now being read/written to the disk.
 // idequeue->qnext points to the next buf to be processed.
+// The first idecmdleft bufs of the queue belong to the command
+// in progress; the rest are waiting in elevator order.
 // You must hold idelock while manipulating queue.
 
 static struct spinlock idelock;
 static struct buf *idequeue;
+static int idecmdleft;     // bufs left in the command in progress
+static int idecmddma;      // command in progress uses DMA
+static uint idehead;       // block after the last one started
+
+// Each buf of a command needs at most two descriptors.
+// Aligned to its size, the table cannot cross 64 KB either.
+static struct prd prdt[2*IDE_MAXSECT] __attribute__((aligned(4096)));
+static ushort dmabase;     // bus-master registers; 0 if using PIO
 
 static int havedisk1;
 static void idestart(struct buf*);
 
+static struct {
+  uint ncmd;    // Commands sent to the disk
+  uint nbuf;    // Bufs transferred by those commands
+} idestats;
+
 // Wait for IDE disk to become ready.
 static int
 idewait(int checkerr)
@@ -47,6 +101,23 @@ idewait(int checkerr)
   return 0;
 }
 
+// Look for a PCI IDE controller with bus-master DMA and
+// enable it. Leaves dmabase 0 if there is none.
+static void
+idedmainit(void)
+{
+  uint tag, bar4;
+
+  if(pcifind(0x01, 0x01, &tag) < 0)   // mass storage, IDE
+    return;
+  bar4 = pciconfread(tag, 0x20);
+  if((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)  // need an I/O BAR
+    return;
+  // Enable I/O space and bus mastering.
+  pciconfwrite(tag, 0x04, pciconfread(tag, 0x04) | 0x5);
+  dmabase = bar4 & 0xfffc;
+}
+
 void
 ideinit(void)
 {
@@ -65,14 +136,55 @@ ideinit(void)
     }
   }
 
+  // With several sectors per block, transfer a whole block
+  // per interrupt in READ/WRITE MULTIPLE commands.
+  if(havedisk1 && BSIZE/SECTOR_SIZE > 1){
+    outb(0x1f2, BSIZE/SECTOR_SIZE);
+    outb(0x1f7, IDE_CMD_SETMUL);
+    idewait(0);
+  }
+
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
+
+  idedmainit();
+}
+
+// Point the bus-master controller at the data of the n bufs
+// starting with b, and set the direction of the transfer.
+static void
+idedmasetup(struct buf *b, int n)
+{
+  struct buf *p;
+  uint pa, len, m;
+  int i, np;
+
+  np = 0;
+  for(i = 0, p = b; i < n; i++, p = p->qnext){
+    pa = V2P(p->data);
+    for(len = BSIZE; len > 0; len -= m, pa += m){
+      m = min(len, 0x10000 - (pa & 0xffff));
+      prdt[np].addr = pa;
+      prdt[np].len = m;
+      prdt[np].flags = 0;
+      np++;
+    }
+  }
+  prdt[np-1].flags = PRD_EOT;
+
+  outl(dmabase+BM_PRDT, V2P(prdt));
+  outb(dmabase+BM_CMD, (b->flags & B_DIRTY) ? 0 : BM_CMD_READ);
+  outb(dmabase+BM_STATUS, BM_STATUS_ERR | BM_STATUS_INT);
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Start the request for b, merged with the requests queued
+// behind it for the following blocks.  Caller must hold idelock.
 static void
 idestart(struct buf *b)
 {
+  struct buf *last;
+  int n;
+
   if(b == 0)
     panic("idestart");
   if(b->blockno >= FSSIZE)
@@ -82,16 +194,36 @@ idestart(struct buf *b)
   int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
   int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
 
-  if (sector_per_block > 7) panic("idestart");
+  if (sector_per_block > 8) panic("idestart");
+
+  // Gather the run of requests this command will serve.
+  n = 1;
+  for(last = b; last->qnext && n < IDE_MAXSECT/sector_per_block; n++){
+    if(last->qnext->dev != b->dev ||
+       last->qnext->blockno != last->blockno + 1 ||
+       (last->qnext->flags & B_DIRTY) != (b->flags & B_DIRTY))
+      break;
+    last = last->qnext;
+  }
+  idecmdleft = n;
+  idecmddma = dmabase != 0;
+  idehead = last->blockno + 1;
+  idestats.ncmd++;
+  idestats.nbuf += n;
+  if(idecmddma)
+    idedmasetup(b, n);
 
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  outb(0x1f2, (n*sector_per_block) & 0xff);  // number of sectors
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
-  if(b->flags & B_DIRTY){
+  if(idecmddma){
+    outb(0x1f7, (b->flags & B_DIRTY) ? IDE_CMD_WRDMA : IDE_CMD_RDDMA);
+    outb(dmabase+BM_CMD, inb(dmabase+BM_CMD) | BM_CMD_START);
+  } else if(b->flags & B_DIRTY){
     outb(0x1f7, write_cmd);
     outsl(0x1f0, b->data, BSIZE/4);
   } else {
@@ -99,6 +231,47 @@ idestart(struct buf *b)
   }
 }
 
+// Mark b done and wake the process waiting for it,
+// or finish an asynchronous read.  Caller must hold idelock.
+static void
+idedone(struct buf *b)
+{
+  b->flags |= B_VALID;
+  b->flags &= ~B_DIRTY;
+  if(b->flags & B_ASYNC){
+    b->flags &= ~B_ASYNC;
+    bdone(b);
+  } else
+    wakeup(b);
+}
+
+// Finish a DMA command: the whole run is done at once.
+// Caller must hold idelock.
+static void
+idedmaintr(void)
+{
+  uchar st, r;
+
+  st = inb(dmabase+BM_STATUS);
+  outb(dmabase+BM_CMD, 0);   // stop the controller
+  outb(dmabase+BM_STATUS, BM_STATUS_ERR | BM_STATUS_INT);
+  r = inb(0x1f7);            // acknowledge the drive
+
+  if((st & BM_STATUS_ERR) || (r & (IDE_DF|IDE_ERR))){
+    cprintf("ide: DMA failed, falling back to PIO\n");
+    dmabase = 0;
+    idestart(idequeue);
+    return;
+  }
+  for(; idecmdleft > 0; idecmdleft--){
+    struct buf *b = idequeue;
+    idequeue = b->qnext;
+    idedone(b);
+  }
+  if(idequeue != 0)
+    idestart(idequeue);
+}
+
 // Interrupt handler.
 void
 ideintr(void)
@@ -112,32 +285,55 @@ ideintr(void)
     release(&idelock);
     return;
   }
+  if(idecmddma){
+    idedmaintr();
+    release(&idelock);
+    return;
+  }
+  // On an error the drive abandons the rest of the command.
+  // A failed write leaves b dirty: reissue the command from b.
+  if((b->flags & B_DIRTY) && idewait(1) < 0){
+    idecmdleft = 0;
+    idestart(b);
+    release(&idelock);
+    return;
+  }
   idequeue = b->qnext;
+  idecmdleft--;
 
-  // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
+  // Read data if needed, reissuing the command for the
+  // other bufs on an error.
+  if(!(b->flags & B_DIRTY)){
+    if(idewait(1) >= 0)
+      insl(0x1f0, b->data, BSIZE/4);
+    else
+      idecmdleft = 0;
+  }
 
-  // Wake process waiting for this buf.
-  b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
-  wakeup(b);
+  idedone(b);
 
-  // Start disk on next buf in queue.
-  if(idequeue != 0)
+  if(idecmdleft > 0 && (idequeue->flags & B_DIRTY) && idewait(1) < 0)
+    idecmdleft = 0;
+  if(idecmdleft > 0){
+    // The command continues with the next buf of the run;
+    // a write must supply its data.
+    if(idequeue->flags & B_DIRTY)
+      outsl(0x1f0, idequeue->data, BSIZE/4);
+  } else if(idequeue != 0){
+    // Start disk on next buf in queue.
     idestart(idequeue);
+  }
 
   release(&idelock);
 }
 
-//PAGEBREAK!
-// Sync buf with disk.
-// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
-// Else if B_VALID is not set, read buf from disk, set B_VALID.
-void
-iderw(struct buf *b)
+// Insert b into idequeue in elevator order, behind the
+// command in progress.  Caller must hold idelock.
+static void
+ideappend(struct buf *b)
 {
   struct buf **pp;
+  int i;
 
   if(!holdingsleep(&b->lock))
     panic("iderw: buf not locked");
@@ -146,23 +342,81 @@ iderw(struct buf *b)
   if(b->dev != 0 && !havedisk1)
     panic("iderw: ide disk 1 not present");
 
-  acquire(&idelock);  //DOC:acquire-lock
+  // Skip the bufs of the command in progress.
+  pp = &idequeue;
+  for(i = 0; i < idecmdleft; i++)
+    pp = &(*pp)->qnext;
 
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
-    ;
+  // Distance from the head, wrapping around, orders
+  // the rest of the queue as one sweep across the disk.
+  for(; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
+    if(b->blockno - idehead < (*pp)->blockno - idehead)
+      break;
+  b->qnext = *pp;
   *pp = b;
+}
+
+//PAGEBREAK!
+// Sync buf with disk.
+// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
+// Else if B_VALID is not set, read buf from disk, set B_VALID.
+void
+iderw(struct buf *b)
+{
+  iderwv(&b, 1);
+}
+
+// Sync n bufs with disk, as iderw() does for one.
+// Queueing them together lets the elevator sort them
+// and merge requests for consecutive blocks.
+void
+iderwv(struct buf **bufs, int n)
+{
+  int i;
+
+  acquire(&idelock);  //DOC:acquire-lock
+
+  for(i = 0; i < n; i++)
+    ideappend(bufs[i]);
 
   // Start disk if necessary.
-  if(idequeue == b)
-    idestart(b);
+  if(idecmdleft == 0 && idequeue != 0)
+    idestart(idequeue);
 
-  // Wait for request to finish.
-  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
-    sleep(b, &idelock);
+  // Wait for requests to finish.
+  for(i = 0; i < n; i++){
+    while((bufs[i]->flags & (B_VALID|B_DIRTY)) != B_VALID){
+      sleep(bufs[i], &idelock);
+    }
   }
 
+  release(&idelock);
+}
+
+// Start reading b from disk without waiting for it.
+// When the read finishes, ideintr() hands b to bdone(),
+// which unlocks it and drops the caller's reference.
+void
+idereadasync(struct buf *b)
+{
+  if(b->flags & B_DIRTY)
+    panic("idereadasync");
+  acquire(&idelock);
+  b->flags |= B_ASYNC;
+  ideappend(b);
+  if(idecmdleft == 0)
+    idestart(idequeue);
+  release(&idelock);
+}
 
+// Print disk command statistics, then zero the
+// counters if reset is set.
+void
+idestat(int reset)
+{
+  acquire(&idelock);
+  cprintf("ide: %d commands for %d blocks\n", idestats.ncmd, idestats.nbuf);
+  if(reset)
+    idestats.ncmd = idestats.nbuf = 0;
   release(&idelock);
 }
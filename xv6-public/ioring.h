@@ -0,0 +1,38 @@
+// Submission and completion rings for ioring_enter(): a process
+// queues operations in sq, advancing sqtail, and one system call
+// runs all of them, each posting its result in cq. The kernel
+// advances sqhead and cqtail, the process cqhead. Indexes run
+// freely and are taken modulo IORING_SIZE.
+
+#define IORING_SIZE 32   // entries per ring; a power of two
+
+// Operations.
+#define IORING_NOP    0
+#define IORING_READ   1  // read(fd, buf, n)
+#define IORING_WRITE  2  // write(fd, buf, n)
+#define IORING_PREAD  3  // pread(fd, buf, n, off)
+#define IORING_PWRITE 4  // pwrite(fd, buf, n, off)
+#define IORING_FSYNC  5  // fsync(fd)
+
+struct iosqe {
+  int op;
+  int fd;
+  void *buf;
+  int n;
+  int off;
+  uint data;   // copied to the completion
+};
+
+struct iocqe {
+  uint data;   // from the submission
+  int res;     // what the system call would have returned
+};
+
+struct ioring {
+  uint sqhead;
+  uint sqtail;
+  uint cqhead;
+  uint cqtail;
+  struct iosqe sq[IORING_SIZE];
+  struct iocqe cq[IORING_SIZE];
+};
@@ -43,6 +43,10 @@
 
 volatile uint *lapic;  // Initialized in mp.c
 
+uint tsckhz;     // TSC cycles per millisecond; 0 if not calibrated
+uint lapickhz;   // LAPIC timer counts per millisecond
+uint64 tscboot;  // TSC when it was calibrated
+
 //PAGEBREAK!
 static void
 lapicw(int index, int value)
@@ -51,22 +55,83 @@ lapicw(int index, int value)
   lapic[ID];  // wait for write to finish, by reading
 }
 
+#define PIT_HZ    1193182  // 8254 timer input clock
+#define PIT_CH2   0x42     // channel 2 counter
+#define PIT_MODE  0x43     // mode and command
+#define PIT_GATE  0x61     // channel 2 gate (bit 0) and output (bit 5)
+#define CALMS     10       // calibration period in milliseconds
+
+// Measure the TSC and the LAPIC timer against the 8254 PIT:
+// run PIT channel 2 down once from CALMS milliseconds' worth
+// of counts, watching its output through port 0x61, and see
+// how far the other two have moved. Leaves tsckhz 0 if the
+// PIT never finishes.
+static void
+lapiccalibrate(void)
+{
+  uint n, tsc0, tsc1, left;
+
+  outb(PIT_GATE, (inb(PIT_GATE) & ~0x02) | 0x01);  // gate on, speaker off
+  outb(PIT_MODE, 0xB0);  // channel 2, lobyte/hibyte, one-shot
+  outb(PIT_CH2, (PIT_HZ/(1000/CALMS)) & 0xFF);
+  outb(PIT_CH2, (PIT_HZ/(1000/CALMS)) >> 8);
+
+  lapicw(TDCR, X1);
+  lapicw(TIMER, MASKED);
+  lapicw(TICR, 0xFFFFFFFF);
+  tsc0 = rdtsc();
+  for(n = 0; (inb(PIT_GATE) & 0x20) == 0; n++)
+    if(n > (1<<24))
+      return;
+  tsc1 = rdtsc();
+  left = lapic[TCCR];
+
+  lapickhz = (0xFFFFFFFF - left) / CALMS;
+  tsckhz = (tsc1 - tsc0) / CALMS;
+  tscboot = rdtsc();
+}
+
+// Make this CPU's one-shot timer interrupt cycles TSC
+// cycles from now, but at most one clock tick away.
+void
+lapicarm(uint cycles)
+{
+  uint count;
+
+  if(cycles > tsckhz*(1000/TICKHZ))
+    cycles = tsckhz*(1000/TICKHZ);
+  count = muldiv(cycles, lapickhz, tsckhz);
+  lapicw(TICR, count ? count : 1);
+}
+
 void
 lapicinit(void)
 {
+  static int calibrated;
+
   if(!lapic)
     return;
 
   // Enable local APIC; set spurious interrupt vector.
   lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
-  // The timer repeatedly counts down at bus frequency
-  // from lapic[TICR] and then issues an interrupt.
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // The first CPU here calibrates the timer against the PIT.
+  // Then the timer counts down at bus frequency once from each
+  // value clockintr() puts in lapic[TICR], and then issues an
+  // interrupt. Without calibration, it repeatedly counts down
+  // from a guess at a clock tick's worth.
+  if(!calibrated){
+    calibrated = 1;
+    lapiccalibrate();
+  }
   lapicw(TDCR, X1);
-  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000);
+  if(tsckhz){
+    lapicw(TIMER, T_IRQ0 + IRQ_TIMER);
+    lapicw(TICR, lapickhz*(1000/TICKHZ));
+  } else {
+    lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+    lapicw(TICR, 10000000);
+  }
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
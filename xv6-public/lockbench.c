@@ -0,0 +1,41 @@
+// Lock-scaling benchmark: run 1, 2, ... up to N processes
+// that each stat() the same file in a loop, so that
+// concurrent path lookups contend on the inode and buffer
+// caches. Reports clock ticks per round; with perfect
+// scaling the time stays flat as processes are added.
+//
+// usage: lockbench [nproc] [iterations]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int nproc, iters, n, i, j, t0;
+  struct stat st;
+
+  nproc = argc > 1 ? atoi(argv[1]) : 4;
+  iters = argc > 2 ? atoi(argv[2]) : 500;
+
+  for(n = 1; n <= nproc; n++){
+    t0 = uptime();
+    for(i = 0; i < n; i++){
+      if(fork() == 0){
+        for(j = 0; j < iters; j++){
+          if(stat("README", &st) < 0){
+            printf(1, "lockbench: stat README failed\n");
+            exit();
+          }
+        }
+        exit();
+      }
+    }
+    for(i = 0; i < n; i++)
+      wait();
+    printf(1, "lockbench: %d procs x %d lookups: %d ticks\n",
+           n, iters, uptime() - t0);
+  }
+  exit();
+}
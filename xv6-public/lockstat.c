@@ -0,0 +1,17 @@
+// Print kernel lock contention statistics.
+// With -r, also zero the counters.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int reset;
+
+  reset = argc > 1 && strcmp(argv[1], "-r") == 0;
+  if(lockstat(reset) < 0)
+    printf(2, "lockstat: kernel not built with LOCKSTAT=1\n");
+  exit();
+}
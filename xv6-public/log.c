@@ -18,7 +18,28 @@
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the log has been installed and emptied.
+//
+// Commits are done by the logcommit kernel process, not by
+// end_op(), so a system call returns as soon as its updates are
+// in the in-memory transaction. The committer waits until the
+// transaction is COMMITTICKS old or fills half the log (group
+// commit), then blocks new operations, waits for the active ones
+// to finish, and commits them all at once. log_sync() (fsync)
+// forces a commit and waits for it.
+//
+// A commit appends the transaction's blocks to the log and
+// rewrites the header; it does not install them. The log holds
+// any number of committed transactions, and the committer copies
+// them to their home locations in the background while new
+// system calls run. Once everything committed is installed, it
+// empties the log by writing a header with no blocks.
+//
+// File data is not logged (ordered mode). log_data() adds a
+// data block to the open transaction's data list, and commit()
+// writes those blocks to their home locations before it writes
+// the log, so committed metadata never points at data that did
+// not reach the disk, and sequential file data is written once.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -27,13 +48,20 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// A block appears more than once if several committed
+// transactions wrote it; the last copy is the current one.
+// The size of the log is chosen by mkfs (-l) and recorded in
+// the superblock; the header limits it to MAXLOG blocks.
+
+#define LOGBATCH 8        // blocks per disk request
+#define MAXDATA 256       // most data blocks per transaction
+#define COMMITTICKS 3     // max age of a transaction before commit
 
 // Contents of the header block, used for both the on-disk header block
-// and to keep track in memory of logged block# before commit.
+// and to keep track in memory of committed blocks.
 struct logheader {
   int n;
-  int block[LOGSIZE];
+  int block[MAXLOG];
 };
 
 struct log {
@@ -42,18 +70,37 @@ struct log {
   int size;
   int outstanding; // how many FS sys calls are executing.
   int committing;  // in commit(), please wait.
+  int force;       // commit as soon as possible.
+  int ncommit;     // commits completed.
+  uint since;      // ticks when the transaction got its first block.
   int dev;
-  struct logheader lh;
+  int maxpin;      // blocks the log may keep pinned in the cache
+  int maxdata;     // data blocks per transaction, at most MAXDATA
+  struct logheader lh;  // committed blocks
+  int ninstalled;  // lh.block[0..ninstalled) are installed.
+  int stalled;     // install waits for the open transaction to commit.
+  int ntxn;        // blocks in the open transaction
+  int txn[MAXLOG];
+  int ndata;       // data blocks in the open transaction
+  int data[MAXDATA];
 };
 struct log log;
 
+static struct {
+  uint ncommit;    // commits
+  uint nlogged;    // blocks written to the log
+  uint ninstall;   // blocks written to their home locations
+  uint ndata;      // data blocks written in ordered mode
+  uint nwait;      // times begin_op() waited for log space
+} logstats;
+
 static void recover_from_log(void);
-static void commit();
+static void logcommitter(void);
 
 void
 initlog(int dev)
 {
-  if (sizeof(struct logheader) >= BSIZE)
+  if (sizeof(struct logheader) > BSIZE)
     panic("initlog: too big logheader");
 
   struct superblock sb;
@@ -62,22 +109,65 @@ initlog(int dev)
   log.start = sb.logstart;
   log.size = sb.nlog;
   log.dev = dev;
+  if (log.size - 1 > MAXLOG || log.size - 1 < 2*MAXOPBLOCKS)
+    panic("initlog: bad log size");
+  // Blocks the log has not written home, and data blocks waiting
+  // for commit, stay pinned in the buffer cache, which promises
+  // only NBUF buffers. Reserve room for all of them, plus
+  // MAXOPBLOCKS for the blocks operations and commit read;
+  // begin_op() keeps within what the cache actually got.
+  log.maxpin = breserve(log.size + MAXDATA + MAXOPBLOCKS) - MAXOPBLOCKS;
+  if (log.maxpin < 2*MAXOPBLOCKS)
+    panic("initlog: buffer cache too small");
+  log.maxdata = min(MAXDATA, log.maxpin - (log.size - 1));
+  if (log.maxdata < MAXOPBLOCKS)
+    log.maxdata = MAXOPBLOCKS;
   recover_from_log();
+  kthread("logcommit", logcommitter);
 }
 
-// Copy committed blocks from log to their home location
+// Is lh.block[i] written again by a later committed transaction?
+static int
+superseded(int i)
+{
+  int j;
+
+  for (j = i+1; j < log.lh.n; j++)
+    if (log.lh.block[j] == log.lh.block[i])
+      return 1;
+  return 0;
+}
+
+// Copy committed blocks from log to their home location,
+// LOGBATCH blocks per disk request. Used only during recovery,
+// when the cache holds nothing newer than the log.
 static void
 install_trans(void)
 {
-  int tail;
+  struct buf *lbuf[LOGBATCH], *dbuf[LOGBATCH];
+  uint lblock[LOGBATCH], dblock[LOGBATCH];
+  int tail, i, n;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    brelse(lbuf);
-    brelse(dbuf);
+  for (tail = 0; tail < log.lh.n; ) {
+    // Gather the next batch of current copies.
+    for (n = 0; n < LOGBATCH && tail < log.lh.n; tail++) {
+      if (superseded(tail))
+        continue;
+      lblock[n] = log.start+tail+1;
+      dblock[n] = log.lh.block[tail];
+      n++;
+    }
+    if (n == 0)
+      break;
+    breadv(log.dev, lblock, n, lbuf); // read log blocks
+    breadv(log.dev, dblock, n, dbuf); // read dsts
+    for (i = 0; i < n; i++)
+      memmove(dbuf[i]->data, lbuf[i]->data, BSIZE);  // copy block to dst
+    bwritev(dbuf, n);  // write dsts to disk
+    for (i = 0; i < n; i++) {
+      brelse(lbuf[i]);
+      brelse(dbuf[i]);
+    }
   }
 }
 
@@ -89,6 +179,8 @@ read_head(void)
   struct logheader *lh = (struct logheader *) (buf->data);
   int i;
   log.lh.n = lh->n;
+  if (log.lh.n < 0 || log.lh.n > log.size - 1)
+    panic("read_head: bad log header");
   for (i = 0; i < log.lh.n; i++) {
     log.lh.block[i] = lh->block[i];
   }
@@ -121,6 +213,15 @@ recover_from_log(void)
   write_head(); // clear the log
 }
 
+// Blocks the log keeps pinned in the buffer cache with B_DIRTY:
+// committed blocks not yet installed and the open transaction's
+// logged and data blocks. Caller must hold log.lock.
+static int
+logpinned(void)
+{
+  return log.lh.n - log.ninstalled + log.ntxn + log.ndata;
+}
+
 // called at the start of each FS system call.
 void
 begin_op(void)
@@ -129,8 +230,20 @@ begin_op(void)
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
+    } else if(log.lh.n + log.ntxn + (log.outstanding+1)*MAXOPBLOCKS > log.size - 1){
+      // this op might exhaust log space; wait for the
+      // committer to install and empty the log.
+      log.force = 1;
+      logstats.nwait++;
+      sleep(&log, &log.lock);
+    } else if(logpinned() + (log.outstanding+1)*MAXOPBLOCKS > log.maxpin){
+      // this op might pin more buffers than the cache is sure
+      // to have; wait for the committer to install some.
+      log.force = 1;
+      sleep(&log, &log.lock);
+    } else if(log.ndata + (log.outstanding+1)*MAXOPBLOCKS > log.maxdata){
+      // this op might overflow the data list; wait for commit.
+      log.force = 1;
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
@@ -141,66 +254,242 @@ begin_op(void)
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// the committer picks up its updates later.
 void
 end_op(void)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
-  } else {
-    // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
-  }
+  // begin_op() may be waiting for log space, since
+  // decrementing log.outstanding has decreased the amount
+  // of reserved space; or the committer may be waiting
+  // for the last outstanding operation.
+  wakeup(&log);
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
+// Wait until every operation that has ended is on disk
+// (committed, though perhaps not yet installed).
+// Must not be called inside begin_op()/end_op().
+void
+log_sync(void)
+{
+  int target;
+
+  acquire(&log.lock);
+  if(log.committing){
+    // the commit in progress holds everything that has ended.
+    target = log.ncommit + 1;
+  } else if(log.ntxn > 0 || log.ndata > 0){
+    target = log.ncommit + 1;
+    log.force = 1;
     wakeup(&log);
+  } else {
     release(&log.lock);
+    return;
   }
+  while(log.ncommit < target)
+    sleep(&log, &log.lock);
+  release(&log.lock);
 }
 
-// Copy modified blocks from cache to log.
+// Copy the n home blocks lh.block[from..from+n) from the cache
+// to their slots in the log, LOGBATCH blocks per disk request.
 static void
-write_log(void)
+write_log(int from, int n)
 {
-  int tail;
+  struct buf *to[LOGBATCH], *src[LOGBATCH];
+  uint lblock[LOGBATCH];
+  int tail, i, m;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  for (tail = from; tail < from + n; tail += m) {
+    m = min(LOGBATCH, from + n - tail);
+    for (i = 0; i < m; i++)
+      lblock[i] = log.start+tail+i+1;
+    breadv(log.dev, lblock, m, to); // log blocks
+    breadv(log.dev, (uint*)&log.lh.block[tail], m, src); // cache blocks
+    for (i = 0; i < m; i++)
+      memmove(to[i]->data, src[i]->data, BSIZE);
+    bwritev(to, m);  // write the log
+    for (i = 0; i < m; i++) {
+      brelse(src[i]);
+      brelse(to[i]);
+    }
   }
 }
 
+// Write the open transaction's data blocks from the cache
+// to their home locations, LOGBATCH blocks per disk request.
 static void
-commit()
-{
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+write_data(void)
+{
+  struct buf *b[LOGBATCH];
+  int tail, i, m;
+
+  for (tail = 0; tail < log.ndata; tail += m) {
+    m = min(LOGBATCH, log.ndata - tail);
+    breadv(log.dev, (uint*)&log.data[tail], m, b);
+    bwritev(b, m);
+    for (i = 0; i < m; i++)
+      brelse(b[i]);
   }
 }
 
+// Commit the open transaction. Called by the committer with
+// log.lock held, log.committing set and no operations active;
+// returns with log.lock held.
+static void
+commit(void)
+{
+  int from, n;
+
+  from = log.lh.n;
+  n = log.ntxn;
+  memmove(&log.lh.block[from], log.txn, n*sizeof(log.txn[0]));
+  log.lh.n += n;
+  log.ntxn = 0;
+  release(&log.lock);
+
+  write_data();       // Write file data to home locations first
+  write_log(from, n); // Write modified blocks from cache to log
+  if (n > 0)
+    write_head();     // Write header to disk -- the real commit
+
+  acquire(&log.lock);
+  logstats.ncommit++;
+  logstats.nlogged += n;
+  logstats.ndata += log.ndata;
+  log.ndata = 0;
+}
+
+// Is block b part of the open transaction?
+// Caller must hold log.lock.
+static int
+intxn(uint b)
+{
+  int i;
+
+  for (i = 0; i < log.ntxn; i++)
+    if (log.txn[i] == b)
+      return 1;
+  return 0;
+}
+
+// Is block b in the log, committed or not?
+// Caller must hold log.lock.
+static int
+inlog(uint b)
+{
+  int i;
+
+  for (i = 0; i < log.lh.n; i++)
+    if (log.lh.block[i] == b)
+      return 1;
+  return intxn(b);
+}
+
+// Does the log hold a copy of block b? balloc() must not
+// hand such a block out for file data.
+int
+log_inuse(uint b)
+{
+  int r;
+
+  acquire(&log.lock);
+  r = inlog(b);
+  release(&log.lock);
+  return r;
+}
+
+// Write up to LOGBATCH committed blocks to their home locations,
+// while other system calls run. The home buffer holds the last
+// committed contents unless the open transaction has changed it
+// since; holding the buffer locked keeps that from changing
+// underfoot. If it has been changed, stall until the next commit,
+// which will log it again. Blocks are written one at a time,
+// since holding several buffer locks could deadlock with a system
+// call that locks them in another order. Returns with log.lock held.
+static void
+install_some(void)
+{
+  struct buf *b;
+  int i, n, stall;
+
+  release(&log.lock);
+  stall = 0;
+  for (i = log.ninstalled, n = 0; i < log.lh.n && n < LOGBATCH; i++, n++) {
+    if (superseded(i))
+      continue;
+    b = bread(log.dev, log.lh.block[i]);
+    acquire(&log.lock);
+    stall = intxn(b->blockno);
+    release(&log.lock);
+    if (stall) {
+      brelse(b);
+      break;
+    }
+    bwrite(b);
+    brelse(b);
+    logstats.ninstall++;
+  }
+
+  acquire(&log.lock);
+  log.ninstalled = i;
+  log.stalled = stall;
+}
+
+// Body of the logcommit kernel process. Commits the open
+// transaction when it is due, installs committed blocks in
+// between, and empties the log once they are all installed.
+static void
+logcommitter(void)
+{
+  acquire(&log.lock);
+  for(;;){
+    if((log.ntxn > 0 || log.ndata > 0) &&
+       (log.force || log.stalled || log.ntxn >= (log.size-1)/2 ||
+        ticks - log.since >= COMMITTICKS)){
+      log.committing = 1;
+      while(log.outstanding > 0)
+        sleep(&log, &log.lock);
+      commit();
+      log.committing = 0;
+      log.force = 0;
+      log.stalled = 0;
+      log.ncommit++;
+      wakeup(&log);
+    } else if(log.ninstalled < log.lh.n && !log.stalled){
+      install_some();
+      wakeup(&log);    // begin_op() may be waiting for buffers
+    } else if(log.lh.n > 0 && log.ninstalled == log.lh.n){
+      log.lh.n = 0;
+      log.ninstalled = 0;
+      log.force = 0;
+      release(&log.lock);
+      write_head();    // Erase the installed transactions
+      acquire(&log.lock);
+      wakeup(&log);    // begin_op() may be waiting for space
+    } else if(log.ntxn > 0 || log.ndata > 0){
+      sleep(&ticks, &log.lock);  // check again next tick
+    } else {
+      sleep(&log, &log.lock);    // end_op() will wake us
+    }
+  }
+}
+
+// Print log statistics to the console; with reset, zero them.
+void
+logstat(int reset)
+{
+  acquire(&log.lock);
+  cprintf("log: %d blocks, %d commits, %d blocks logged, %d installed, "
+          "%d waits for space, %d data blocks\n", log.size, logstats.ncommit,
+          logstats.nlogged, logstats.ninstall, logstats.nwait, logstats.ndata);
+  if(reset)
+    memset(&logstats, 0, sizeof(logstats));
+  release(&log.lock);
+}
+
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache with B_DIRTY.
 // commit()/write_log() will do the disk write.
@@ -215,20 +504,55 @@ log_write(struct buf *b)
 {
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
-    panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
 
   acquire(&log.lock);
-  for (i = 0; i < log.lh.n; i++) {
-    if (log.lh.block[i] == b->blockno)   // log absorbtion
+  if (log.lh.n + log.ntxn >= log.size - 1)
+    panic("too big a transaction");
+  for (i = 0; i < log.ntxn; i++) {
+    if (log.txn[i] == b->blockno)   // log absorbtion
       break;
   }
-  log.lh.block[i] = b->blockno;
-  if (i == log.lh.n)
-    log.lh.n++;
+  log.txn[i] = b->blockno;
+  if (i == log.ntxn) {
+    if (log.ntxn == 0 && log.ndata == 0)
+      log.since = ticks;
+    log.ntxn++;
+  }
   b->flags |= B_DIRTY; // prevent eviction
   release(&log.lock);
 }
 
+// Like log_write(), for a block of file data: commit() will write
+// it to its home location, ahead of the metadata that refers to
+// it. A block the log already holds is logged instead, so that
+// recovery cannot replay an older copy over it.
+void
+log_data(struct buf *b)
+{
+  int i;
+
+  if (log.outstanding < 1)
+    panic("log_data outside of trans");
+
+  acquire(&log.lock);
+  if (inlog(b->blockno)) {
+    release(&log.lock);
+    log_write(b);
+    return;
+  }
+  for (i = 0; i < log.ndata; i++) {
+    if (log.data[i] == b->blockno)
+      break;
+  }
+  if (i == log.ndata) {
+    if (log.ndata >= log.maxdata)
+      panic("too much data in transaction");
+    if (log.ntxn == 0 && log.ndata == 0)
+      log.since = ticks;
+    log.data[log.ndata++] = b->blockno;
+  }
+  b->flags |= B_DIRTY; // prevent eviction until commit writes it
+  release(&log.lock);
+}
@@ -0,0 +1,58 @@
+// Log throughput benchmark, after usertests' fourfiles: run
+// 1, 2, ... up to N processes that each create their own file
+// and fill it with small writes, so that concurrent system
+// calls share log commits. Reports clock ticks and blocks
+// written per round; run fsstat afterwards for log statistics.
+//
+// usage: logbench [nproc] [writes]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+char buf[512];
+
+int
+main(int argc, char *argv[])
+{
+  int nproc, nwrite, n, i, j, fd, t0;
+  char name[3];
+
+  nproc = argc > 1 ? atoi(argv[1]) : 4;
+  nwrite = argc > 2 ? atoi(argv[2]) : 40;
+
+  name[0] = 'l';
+  name[2] = '\0';
+  for(n = 1; n <= nproc; n++){
+    t0 = uptime();
+    for(i = 0; i < n; i++){
+      if(fork() == 0){
+        name[1] = '0' + i;
+        if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+          printf(1, "logbench: create %s failed\n", name);
+          exit();
+        }
+        memset(buf, '0' + i, sizeof(buf));
+        for(j = 0; j < nwrite; j++){
+          if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+            printf(1, "logbench: write %s failed\n", name);
+            exit();
+          }
+        }
+        fsync(fd);
+        close(fd);
+        exit();
+      }
+    }
+    for(i = 0; i < n; i++)
+      wait();
+    printf(1, "logbench: %d procs x %d blocks: %d ticks\n",
+           n, nwrite, uptime() - t0);
+    for(i = 0; i < n; i++){
+      name[1] = '0' + i;
+      unlink(name);
+    }
+  }
+  exit();
+}
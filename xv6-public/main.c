@@ -28,8 +28,12 @@ main(void)
   uartinit();      // serial port
   pinit();         // process table
   tvinit();        // trap vectors
+  clockinit();     // high-resolution timers
+  vdatainit();     // page shared with user processes
   binit();         // buffer cache
+  dcacheinit();    // directory entry cache
   fileinit();      // file table
+  futexinit();     // futex wait queues
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
@@ -53,6 +57,8 @@ mpmain(void)
 {
   cprintf("cpu%d: starting %d\n", cpuid(), cpuid());
   idtinit();       // load idt register
+  sysenterinit();  // fast system call entry
+  clockstart();    // start this CPU's clock ticks
   xchg(&(mycpu()->started), 1); // tell startothers() we're up
   scheduler();     // start running processes
 }
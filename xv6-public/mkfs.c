@@ -22,7 +22,7 @@
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog = LOGSIZE;   // log blocks, including the header; -l to change
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -32,6 +32,12 @@ char zeroes[BSIZE];
 uint freeinode = 1;
 uint freeblock;
 
+// The root directory is built in memory as a hashed
+// directory (see fs.h) and written out at the end.
+#define ROOTBLKS 64
+char rootdir[ROOTBLKS][BSIZE];
+int nrootblk = 1;  // block 0 is the header
+
 
 void balloc(int);
 void wsect(uint, void*);
@@ -40,6 +46,8 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void rootlink(char *name, uint inum);
+int rootsplit(uint fbn, char *name);
 
 // convert to intel byte order
 ushort
@@ -68,16 +76,25 @@ int
 main(int argc, char *argv[])
 {
   int i, cc, fd;
-  uint rootino, inum, off;
-  struct dirent de;
+  uint rootino, inum;
   char buf[BSIZE];
   struct dinode din;
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
+  if(argc >= 3 && strcmp(argv[1], "-l") == 0){
+    nlog = atoi(argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-l nlog] fs.img files...\n");
+    exit(1);
+  }
+  if(nlog < 2*MAXOPBLOCKS+1 || nlog > MAXLOG+1){
+    fprintf(stderr, "mkfs: log must be %d to %d blocks\n",
+            2*MAXOPBLOCKS+1, (int)MAXLOG+1);
     exit(1);
   }
 
@@ -101,9 +118,10 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.bsize = xint(BSIZE);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d of %d bytes\n",
+         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE, BSIZE);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
@@ -117,15 +135,9 @@ main(int argc, char *argv[])
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
 
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
-
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
+  ((struct dirhdr*)rootdir[0])->depth = xshort(1);  // one bucket
+  rootlink(".", rootino);
+  rootlink("..", rootino);
 
   for(i = 2; i < argc; i++){
     assert(index(argv[i], '/') == 0);
@@ -143,11 +155,7 @@ main(int argc, char *argv[])
       ++argv[i];
 
     inum = ialloc(T_FILE);
-
-    bzero(&de, sizeof(de));
-    de.inum = xshort(inum);
-    strncpy(de.name, argv[i], DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    rootlink(argv[i], inum);
 
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
@@ -155,11 +163,10 @@ main(int argc, char *argv[])
     close(fd);
   }
 
-  // fix size of root inode dir
+  // write out the root directory and mark it hashed
+  iappend(rootino, rootdir, nrootblk*BSIZE);
   rinode(rootino, &din);
-  off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
-  din.size = xint(off);
+  din.major = xshort(DIRHASHED);
   winode(rootino, &din);
 
   balloc(freeblock);
@@ -167,6 +174,101 @@ main(int argc, char *argv[])
   exit(0);
 }
 
+// Bucket pointer k in the root directory's header.
+uint*
+rootptr(uint k)
+{
+  return &((struct dirhdr*)rootdir[0])[k/3].blk[k%3];
+}
+
+// Add (name, inum) to the root directory, in name's bucket,
+// splitting a full bucket the way fs.c's hdirslot() does.
+void
+rootlink(char *name, uint inum)
+{
+  struct dirent *de;
+  uint g, b, fbn, last;
+  int i, split;
+
+  for(split = 0; ; split = 1){
+    g = dirdepth(xshort(((struct dirhdr*)rootdir[0])->depth));
+    b = dirhash(name) & ((1 << g) - 1);
+    last = 0;
+    for(fbn = xint(*rootptr(b)); fbn != 0; fbn = xint(((struct dirhdr*)rootdir[fbn])->blk[0])){
+      de = (struct dirent*)rootdir[fbn];
+      for(i = 1; i < DPB; i++){
+        if(de[i].inum == 0){
+          de[i].inum = xshort(inum);
+          strncpy(de[i].name, name, DIRSIZ);
+          return;
+        }
+      }
+      last = fbn;
+    }
+    assert(!split);
+    if(last == 0 || xint(*rootptr(b)) != last || !rootsplit(last, name))
+      break;
+  }
+
+  // Bucket is empty or full: add a block.
+  assert(nrootblk < ROOTBLKS);
+  fbn = nrootblk++;
+  if(last == 0){
+    *rootptr(b) = xint(fbn);
+    ((struct dirhdr*)rootdir[fbn])->depth = ((struct dirhdr*)rootdir[0])->depth;
+  } else
+    ((struct dirhdr*)rootdir[last])->blk[0] = xint(fbn);
+  de = (struct dirent*)rootdir[fbn];
+  de[1].inum = xshort(inum);
+  strncpy(de[1].name, name, DIRSIZ);
+}
+
+// Split root directory bucket block fbn, as fs.c's hdirsplit() does.
+int
+rootsplit(uint fbn, char *name)
+{
+  struct dirhdr *h, *ob, *nb;
+  struct dirent *ode, *nde;
+  uint g, d, k, i, j, nfbn, bit;
+
+  h = (struct dirhdr*)rootdir[0];
+  ob = (struct dirhdr*)rootdir[fbn];
+  ode = (struct dirent*)ob;
+  g = dirdepth(xshort(h->depth));
+  d = dirdepth(xshort(ob->depth));
+  if(d == g && (2 << g) > NDIRBUCKET)
+    return 0;
+  bit = (dirhash(name) >> d) & 1;
+  for(i = 1; i < DPB; i++)
+    if(ode[i].inum == 0 || ((dirhash(ode[i].name) >> d) & 1) != bit)
+      break;
+  if(i == DPB)
+    return 0;
+
+  assert(nrootblk < ROOTBLKS);
+  nfbn = nrootblk++;
+  nb = (struct dirhdr*)rootdir[nfbn];
+  if(d == g){
+    for(k = 0; k < (1 << g); k++)
+      *rootptr(k + (1 << g)) = *rootptr(k);
+    g++;
+    h->depth = xshort(g + 1);
+  }
+  for(k = 0; k < (1 << g); k++)
+    if(xint(*rootptr(k)) == fbn && (k >> d) & 1)
+      *rootptr(k) = xint(nfbn);
+
+  nde = (struct dirent*)nb;
+  for(i = j = 1; i < DPB; i++){
+    if(ode[i].inum != 0 && (dirhash(ode[i].name) >> d) & 1){
+      nde[j++] = ode[i];
+      memset(&ode[i], 0, sizeof(ode[i]));
+    }
+  }
+  ob->depth = nb->depth = xshort(d + 2);
+  return 1;
+}
+
 void
 wsect(uint sec, void *buf)
 {
@@ -260,7 +362,7 @@ iappend(uint inum, void *xp, int n)
   struct dinode din;
   char buf[BSIZE];
   uint indirect[NINDIRECT];
-  uint x;
+  uint x, ind;
 
   rinode(inum, &din);
   off = xint(din.size);
@@ -273,7 +375,7 @@ iappend(uint inum, void *xp, int n)
         din.addrs[fbn] = xint(freeblock++);
       }
       x = xint(din.addrs[fbn]);
-    } else {
+    } else if(fbn < NDIRECT + NINDIRECT){
       if(xint(din.addrs[NDIRECT]) == 0){
         din.addrs[NDIRECT] = xint(freeblock++);
       }
@@ -283,6 +385,25 @@ iappend(uint inum, void *xp, int n)
         wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
       }
       x = xint(indirect[fbn-NDIRECT]);
+    } else {
+      // double-indirect block, then the indirect block under it
+      if(xint(din.addrs[NDIRECT+1]) == 0){
+        din.addrs[NDIRECT+1] = xint(freeblock++);
+      }
+      rsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      x = (fbn - NDIRECT - NINDIRECT) / NINDIRECT;
+      if(indirect[x] == 0){
+        indirect[x] = xint(freeblock++);
+        wsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      }
+      ind = xint(indirect[x]);
+      rsect(ind, (char*)indirect);
+      x = (fbn - NDIRECT - NINDIRECT) % NINDIRECT;
+      if(indirect[x] == 0){
+        indirect[x] = xint(freeblock++);
+        wsect(ind, (char*)indirect);
+      }
+      x = xint(indirect[x]);
     }
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
@@ -2,7 +2,9 @@
 // x86 memory management unit (MMU).
 
 // Eflags register
+#define FL_TF           0x00000100      // Trap Flag
 #define FL_IF           0x00000200      // Interrupt Enable
+#define FL_NT           0x00004000      // Nested Task
 
 // Control Register flags
 #define CR0_PE          0x00000001      // Protection Enable
@@ -11,6 +13,14 @@
 
 #define CR4_PSE         0x00000010      // Page size extension
 
+// Model-specific registers for sysenter
+#define MSR_SYSENTER_CS  0x174  // kernel code segment selector
+#define MSR_SYSENTER_ESP 0x175  // kernel stack pointer
+#define MSR_SYSENTER_EIP 0x176  // kernel entry point
+
+// cpuid 1 %edx feature flags
+#define CPUID_SEP       0x00000800      // sysenter and sysexit
+
 // various segment selectors.
 #define SEG_KCODE 1  // kernel code
 #define SEG_KDATA 2  // kernel data+stack
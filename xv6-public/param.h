@@ -3,12 +3,16 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // initial size of inode cache
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
-#define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define MAXOPBLOCKS  12  // max # of blocks any FS op writes (mkdir: 11)
+#define LOGSIZE      (MAXOPBLOCKS*6)  // default log blocks (mkfs -l)
+#define NBUF         (MAXOPBLOCKS*3)  // initial size of disk block cache
+#define TICKHZ      100  // clock ticks per second
+#ifndef FSSIZE
+#define FSSIZE       4000  // size of file system in blocks (make FSSIZE=n)
+#endif
+#define RAMAX        16  // max blocks of sequential read-ahead per file
 
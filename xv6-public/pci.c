@@ -0,0 +1,54 @@
+// Minimal PCI configuration space access, using the
+// legacy I/O port mechanism (configuration mechanism #1).
+// Only bus 0 is scanned, which is where QEMU and Bochs
+// put their built-in devices.
+
+#include "types.h"
+#include "defs.h"
+#include "x86.h"
+
+#define PCI_CONFADDR 0xCF8
+#define PCI_CONFDATA 0xCFC
+
+#define PCI_TAG(bus, dev, func) (((bus)<<16) | ((dev)<<11) | ((func)<<8))
+
+// Read the 32-bit configuration register at offset off
+// of the device named by tag.
+uint
+pciconfread(uint tag, int off)
+{
+  outl(PCI_CONFADDR, 0x80000000 | tag | (off & 0xfc));
+  return inl(PCI_CONFDATA);
+}
+
+void
+pciconfwrite(uint tag, int off, uint v)
+{
+  outl(PCI_CONFADDR, 0x80000000 | tag | (off & 0xfc));
+  outl(PCI_CONFDATA, v);
+}
+
+// Find the first function on bus 0 with the given class
+// and subclass, and store its tag in *tagp.
+// Returns 0 on success, -1 if there is none.
+int
+pcifind(int class, int subclass, uint *tagp)
+{
+  int dev, func;
+  uint tag, id, cl;
+
+  for(dev = 0; dev < 32; dev++){
+    for(func = 0; func < 8; func++){
+      tag = PCI_TAG(0, dev, func);
+      id = pciconfread(tag, 0x00);
+      if((id & 0xffff) == 0xffff)   // no such function
+        continue;
+      cl = pciconfread(tag, 0x08);
+      if((cl >> 24) == class && ((cl >> 16) & 0xff) == subclass){
+        *tagp = tag;
+        return 0;
+      }
+    }
+  }
+  return -1;
+}
@@ -8,21 +8,55 @@
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+// The pipe buffer is a ring of PIPEPAGES pages, copied in and
+// out a page-contiguous chunk at a time. To keep the reader and
+// writer from waking each other for every few bytes, a sleeping
+// reader is woken in the middle of a write only once PIPEWAKE
+// bytes are waiting (and always when the write ends), and a
+// sleeping writer only once PIPEWAKE bytes are free.
+
+#define PIPEPAGES 4
+#define PIPESIZE (PIPEPAGES*PGSIZE)   // a power of two
+#define PIPEWAKE (PIPESIZE/4)
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *page[PIPEPAGES];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int rwait;      // a reader sleeps on nread
+  int wwait;      // a writer sleeps on nwrite
+  int rbusy;      // a splice is copying data out of the ring
+  int wbusy;      // a splice is copying data into the ring
 };
 
+static void
+pipefree(struct pipe *p)
+{
+  int i;
+
+  for(i = 0; i < PIPEPAGES; i++)
+    if(p->page[i])
+      kfree(p->page[i]);
+  kfree((char*)p);
+}
+
+// Address of byte n of the ring and the number of bytes
+// that follow it in the same page.
+static char*
+pipeaddr(struct pipe *p, uint n, uint *left)
+{
+  *left = PGSIZE - n%PGSIZE;
+  return p->page[(n/PGSIZE) % PIPEPAGES] + n%PGSIZE;
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
   struct pipe *p;
+  int i;
 
   p = 0;
   *f0 = *f1 = 0;
@@ -30,6 +64,10 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((p = (struct pipe*)kalloc()) == 0)
     goto bad;
+  memset(p, 0, sizeof(*p));
+  for(i = 0; i < PIPEPAGES; i++)
+    if((p->page[i] = kalloc()) == 0)
+      goto bad;
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
@@ -48,7 +86,7 @@ pipealloc(struct file **f0, struct file **f1)
 //PAGEBREAK: 20
  bad:
   if(p)
-    kfree((char*)p);
+    pipefree(p);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -69,7 +107,7 @@ pipeclose(struct pipe *p, int writable)
   }
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
-    kfree((char*)p);
+    pipefree(p);
   } else
     release(&p->lock);
 }
@@ -78,21 +116,41 @@ pipeclose(struct pipe *p, int writable)
 int
 pipewrite(struct pipe *p, char *addr, int n)
 {
+  uint m, left;
+  char *dst;
   int i;
 
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
-    while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
+  for(i = 0; i < n; i += m){
+    while(p->wbusy || p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
       if(p->readopen == 0 || myproc()->killed){
         release(&p->lock);
         return -1;
       }
-      wakeup(&p->nread);
+      if(p->rwait && p->nwrite != p->nread){
+        p->rwait = 0;
+        wakeup(&p->nread);
+      }
+      p->wwait = 1;
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    m = n - i;
+    if(m > PIPESIZE - (p->nwrite - p->nread))
+      m = PIPESIZE - (p->nwrite - p->nread);
+    dst = pipeaddr(p, p->nwrite, &left);
+    if(m > left)
+      m = left;
+    memmove(dst, addr + i, m);
+    p->nwrite += m;
+    if(p->rwait && p->nwrite - p->nread >= PIPEWAKE){
+      p->rwait = 0;
+      wakeup(&p->nread);
+    }
+  }
+  if(p->rwait){
+    p->rwait = 0;
+    wakeup(&p->nread);  //DOC: pipewrite-wakeup1
   }
-  wakeup(&p->nread);  //DOC: pipewrite-wakeup1
   release(&p->lock);
   return n;
 }
@@ -100,22 +158,131 @@ pipewrite(struct pipe *p, char *addr, int n)
 int
 piperead(struct pipe *p, char *addr, int n)
 {
+  uint m, left;
+  char *src;
   int i;
 
   acquire(&p->lock);
-  while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
+  while(p->rbusy || (p->nread == p->nwrite && p->writeopen)){  //DOC: pipe-empty
     if(myproc()->killed){
       release(&p->lock);
       return -1;
     }
+    p->rwait = 1;
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
-      break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+  for(i = 0; i < n && p->nread != p->nwrite; i += m){  //DOC: piperead-copy
+    m = n - i;
+    if(m > p->nwrite - p->nread)
+      m = p->nwrite - p->nread;
+    src = pipeaddr(p, p->nread, &left);
+    if(m > left)
+      m = left;
+    memmove(addr + i, src, m);
+    p->nread += m;
+  }
+  if(p->wwait && PIPESIZE - (p->nwrite - p->nread) >= PIPEWAKE){
+    p->wwait = 0;
+    wakeup(&p->nwrite);  //DOC: piperead-wakeup
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
   release(&p->lock);
   return i;
 }
+
+//PAGEBREAK: 40
+// Splicing moves data between a pipe and a file without a
+// user buffer: the file is read straight into the ring, or
+// written straight from it. pipebeginwrite() waits for free
+// space and returns in *addr the start of at most n bytes of
+// it that are contiguous, and their count; the caller fills
+// them with the pipe unlocked, then calls pipeendwrite() with
+// the number it filled. wbusy keeps other writers out in the
+// meantime. pipebeginread() and pipeendread() do the same for
+// data in the ring, except that pipebeginread() returns 0 at
+// end of file, or at once if the ring is empty and wait is 0.
+int
+pipebeginwrite(struct pipe *p, char **addr, int n)
+{
+  uint left;
+
+  acquire(&p->lock);
+  while(p->wbusy || p->nwrite == p->nread + PIPESIZE){
+    if(p->readopen == 0 || myproc()->killed){
+      release(&p->lock);
+      return -1;
+    }
+    if(p->rwait && p->nwrite != p->nread){
+      p->rwait = 0;
+      wakeup(&p->nread);
+    }
+    p->wwait = 1;
+    sleep(&p->nwrite, &p->lock);
+  }
+  if(n > PIPESIZE - (p->nwrite - p->nread))
+    n = PIPESIZE - (p->nwrite - p->nread);
+  *addr = pipeaddr(p, p->nwrite, &left);
+  if(n > left)
+    n = left;
+  p->wbusy = 1;
+  release(&p->lock);
+  return n;
+}
+
+void
+pipeendwrite(struct pipe *p, int n)
+{
+  acquire(&p->lock);
+  p->nwrite += n;
+  p->wbusy = 0;
+  if(p->rwait && p->nwrite != p->nread){
+    p->rwait = 0;
+    wakeup(&p->nread);
+  }
+  if(p->wwait){
+    p->wwait = 0;
+    wakeup(&p->nwrite);
+  }
+  release(&p->lock);
+}
+
+int
+pipebeginread(struct pipe *p, char **addr, int n, int wait)
+{
+  uint left;
+
+  acquire(&p->lock);
+  while(p->rbusy || (p->nread == p->nwrite && p->writeopen && wait)){
+    if(myproc()->killed){
+      release(&p->lock);
+      return -1;
+    }
+    p->rwait = 1;
+    sleep(&p->nread, &p->lock);
+  }
+  if(n > p->nwrite - p->nread)
+    n = p->nwrite - p->nread;
+  *addr = pipeaddr(p, p->nread, &left);
+  if(n > left)
+    n = left;
+  if(n > 0)
+    p->rbusy = 1;
+  release(&p->lock);
+  return n;
+}
+
+void
+pipeendread(struct pipe *p, int n)
+{
+  acquire(&p->lock);
+  p->nread += n;
+  p->rbusy = 0;
+  if(p->wwait){
+    p->wwait = 0;
+    wakeup(&p->nwrite);
+  }
+  if(p->rwait){
+    p->rwait = 0;
+    wakeup(&p->nread);
+  }
+  release(&p->lock);
+}
@@ -0,0 +1,59 @@
+// Pipe bandwidth benchmark: a child writes through a pipe to
+// its parent, which reads and checks the count. With several
+// CPUs the two usually run on different ones.
+// Reports clock ticks and kilobytes per tick.
+//
+// usage: pipebench [kbytes] [chunk]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+char buf[8192];
+
+int
+main(int argc, char *argv[])
+{
+  int kb, chunk, fds[2], n, t, t0;
+  uint total, got;
+
+  kb = argc > 1 ? atoi(argv[1]) : 4096;
+  chunk = argc > 2 ? atoi(argv[2]) : 4096;
+  if(chunk <= 0 || chunk > sizeof(buf)){
+    printf(2, "pipebench: chunk must be 1..%d\n", sizeof(buf));
+    exit();
+  }
+  total = kb * 1024;
+
+  if(pipe(fds) != 0){
+    printf(2, "pipebench: pipe failed\n");
+    exit();
+  }
+  t0 = uptime();
+  if(fork() == 0){
+    close(fds[0]);
+    memset(buf, 'p', sizeof(buf));
+    for(got = 0; got < total; got += n){
+      n = total - got < chunk ? total - got : chunk;
+      if(write(fds[1], buf, n) != n){
+        printf(2, "pipebench: write failed\n");
+        exit();
+      }
+    }
+    exit();
+  }
+  close(fds[1]);
+  got = 0;
+  while((n = read(fds[0], buf, chunk)) > 0)
+    got += n;
+  close(fds[0]);
+  wait();
+  t = uptime() - t0;
+  if(got != total){
+    printf(2, "pipebench: read %d bytes, expected %d\n", got, total);
+    exit();
+  }
+  printf(1, "pipebench: %d KB in %d-byte chunks: %d ticks, %d KB/tick\n",
+         kb, chunk, t, t ? kb / t : kb);
+  exit();
+}
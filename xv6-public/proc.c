@@ -7,6 +7,7 @@
 #include "proc.h"
 #include "spinlock.h"
 #include "mmap.h"
+#include "vdata.h"
 
 struct {
   struct spinlock lock;
@@ -89,14 +90,24 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->children = 0;
+  p->sibling = 0;
 
   release(&ptable.lock);
 
-  // Allocate kernel stack.
+  // Allocate kernel stack and the page user code reads its pid from.
   if((p->kstack = kalloc()) == 0){
     p->state = UNUSED;
     return 0;
   }
+  if((p->vproc = kalloc()) == 0){
+    kfree(p->kstack);
+    p->kstack = 0;
+    p->state = UNUSED;
+    return 0;
+  }
+  memset(p->vproc, 0, PGSIZE);
+  ((struct vproc*)p->vproc)->pid = p->pid;
   sp = p->kstack + KSTACKSIZE;
 
   // Leave room for trap frame.
@@ -130,6 +141,8 @@ userinit(void)
   if((p->pgdir = setupkvm()) == 0)
     panic("userinit: out of memory?");
   inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
+  if(mapvdata(p->pgdir, p) < 0)
+    panic("userinit: out of memory?");
   p->sz = PGSIZE;
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
@@ -154,6 +167,24 @@ userinit(void)
   release(&ptable.lock);
 }
 
+// Start a kernel-only process running fn, which must never return.
+// It has no user memory; its page table maps just the kernel.
+void
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0 || (p->pgdir = setupkvm()) == 0)
+    panic("kthread");
+  // forkret "returns" to fn instead of trapret.
+  *(uint*)(p->context + 1) = (uint)fn;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&ptable.lock);
+  p->state = RUNNABLE;
+  release(&ptable.lock);
+}
+
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -191,14 +222,19 @@ fork(void)
   }
 
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0 ||
+     mapvdata(np->pgdir, np) < 0){
+    if(np->pgdir)
+      freevm(np->pgdir);
+    np->pgdir = 0;
     kfree(np->kstack);
     np->kstack = 0;
+    kfree(np->vproc);
+    np->vproc = 0;
     np->state = UNUSED;
     return -1;
   }
   np->sz = curproc->sz;
-  np->parent = curproc;
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
@@ -239,6 +275,9 @@ fork(void)
 
   acquire(&ptable.lock);
 
+  np->parent = curproc;
+  np->sibling = curproc->children;
+  curproc->children = np;
   np->state = RUNNABLE;
 
   release(&ptable.lock);
@@ -277,13 +316,19 @@ exit(void)
   // Parent might be sleeping in wait().
   wakeup1(curproc->parent);
 
-  // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == curproc){
+  // Pass abandoned children to init by splicing
+  // our child list onto the front of init's.
+  if(curproc->children){
+    for(p = curproc->children; ; p = p->sibling){
       p->parent = initproc;
       if(p->state == ZOMBIE)
         wakeup1(initproc);
+      if(p->sibling == 0)
+        break;
     }
+    p->sibling = initproc->children;
+    initproc->children = curproc->children;
+    curproc->children = 0;
   }
 
   // Jump into the scheduler, never to return.
@@ -297,26 +342,26 @@ exit(void)
 int
 wait(void)
 {
-  struct proc *p;
-  int havekids, pid;
+  struct proc *p, **pp;
+  int pid;
   struct proc *curproc = myproc();
   
   acquire(&ptable.lock);
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
-        continue;
-      havekids = 1;
+    // Scan through our children looking for exited ones.
+    for(pp = &curproc->children; (p = *pp) != 0; pp = &p->sibling){
       if(p->state == ZOMBIE){
         // Found one.
+        *pp = p->sibling;
         pid = p->pid;
         kfree(p->kstack);
         p->kstack = 0;
+        kfree(p->vproc);
+        p->vproc = 0;
         freevm(p->pgdir);
         p->pid = 0;
         p->parent = 0;
+        p->sibling = 0;
         p->name[0] = 0;
         p->killed = 0;
         p->state = UNUSED;
@@ -326,7 +371,7 @@ wait(void)
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || curproc->killed){
+    if(curproc->children == 0 || curproc->killed){
       release(&ptable.lock);
       return -1;
     }
@@ -432,6 +477,7 @@ forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    bsummary(ROOTDEV);
   }
 
   // Return to "caller", actually trapret (see allocproc).
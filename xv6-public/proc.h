@@ -8,6 +8,8 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  uint64 nexttick;             // TSC at this CPU's next clock tick
+  uint64 armed;                // TSC the LAPIC timer will go off at
 };
 
 extern struct cpu cpus[NCPU];
@@ -50,9 +52,12 @@ struct proc {
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
   char *kstack;                // Bottom of kernel stack for this process
+  char *vproc;                 // Page mapped read-only at VPROC
   enum procstate state;        // Process state
   int pid;                     // Process ID
   struct proc *parent;         // Parent process
+  struct proc *children;       // First child, linked through sibling
+  struct proc *sibling;        // Next child of the same parent
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
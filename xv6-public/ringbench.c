@@ -0,0 +1,78 @@
+// ioring benchmark: write n small records to a file, first
+// with one write() each, then queued IORING_SIZE at a time
+// in an ioring and run with one ioring_enter() per batch.
+// Reports clock ticks for both.
+//
+// usage: ringbench [records] [size]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "ioring.h"
+
+char buf[512];
+struct ioring ring;
+
+int
+main(int argc, char *argv[])
+{
+  int nrec, size, fd, i, j, n, t0, t1;
+  struct iosqe *e;
+
+  nrec = argc > 1 ? atoi(argv[1]) : 2000;
+  size = argc > 2 ? atoi(argv[2]) : 16;
+  if(size <= 0 || size > sizeof(buf)){
+    printf(2, "ringbench: size must be 1..%d\n", sizeof(buf));
+    exit();
+  }
+  memset(buf, 'r', sizeof(buf));
+
+  if((fd = open("ringbench.tmp", O_CREATE|O_RDWR)) < 0){
+    printf(2, "ringbench: create failed\n");
+    exit();
+  }
+  t0 = uptime();
+  for(i = 0; i < nrec; i++){
+    if(write(fd, buf, size) != size){
+      printf(2, "ringbench: write failed\n");
+      exit();
+    }
+  }
+  t0 = uptime() - t0;
+  close(fd);
+  unlink("ringbench.tmp");
+
+  if((fd = open("ringbench.tmp", O_CREATE|O_RDWR)) < 0){
+    printf(2, "ringbench: create failed\n");
+    exit();
+  }
+  t1 = uptime();
+  for(i = 0; i < nrec; i += n){
+    n = nrec - i < IORING_SIZE ? nrec - i : IORING_SIZE;
+    for(j = 0; j < n; j++){
+      e = &ring.sq[ring.sqtail++ % IORING_SIZE];
+      e->op = IORING_WRITE;
+      e->fd = fd;
+      e->buf = buf;
+      e->n = size;
+    }
+    if(ioring_enter(&ring) != n){
+      printf(2, "ringbench: ioring_enter failed\n");
+      exit();
+    }
+    for(; ring.cqhead != ring.cqtail; ring.cqhead++){
+      if(ring.cq[ring.cqhead % IORING_SIZE].res != size){
+        printf(2, "ringbench: write failed\n");
+        exit();
+      }
+    }
+  }
+  t1 = uptime() - t1;
+  close(fd);
+  unlink("ringbench.tmp");
+
+  printf(1, "ringbench: %d writes of %d bytes: %d ticks with write(), "
+         "%d ticks with ioring\n", nrec, size, t0, t1);
+  exit();
+}
@@ -0,0 +1,95 @@
+// Reader-writer spin locks, for read-mostly structures
+// whose lookups would otherwise serialize on a spinlock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "rwlock.h"
+
+void
+initrwlock(struct rwlock *lk, char *name)
+{
+  lk->name = name;
+  lk->readers = 0;
+  lk->writer = 0;
+  lk->cpu = 0;
+}
+
+// Acquire the lock shared with other readers.
+// Must not be called while already holding lk in either mode.
+void
+acquireread(struct rwlock *lk)
+{
+  pushcli(); // disable interrupts to avoid deadlock.
+
+  for(;;){
+    while(lk->writer)
+      pause();
+    // The xadd is a full barrier: either the writer sees our
+    // count before checking readers, or we see its flag here.
+    fetchadd(&lk->readers, 1);
+    if(lk->writer == 0)
+      break;
+    fetchadd(&lk->readers, -1);
+  }
+}
+
+void
+releaseread(struct rwlock *lk)
+{
+  if(lk->readers == 0)
+    panic("releaseread");
+
+  // Keep critical-section loads before the count drops.
+  __sync_synchronize();
+  fetchadd(&lk->readers, -1);
+
+  popcli();
+}
+
+// Acquire the lock exclusively.
+void
+acquirewrite(struct rwlock *lk)
+{
+  pushcli();
+  if(holdingwrite(lk))
+    panic("acquirewrite");
+
+  // Claim the writer flag first to shut out new readers,
+  // then wait for the current ones to drain.
+  while(xchg(&lk->writer, 1) != 0)
+    pause();
+  while(lk->readers != 0)
+    pause();
+
+  __sync_synchronize();
+  lk->cpu = mycpu();
+}
+
+void
+releasewrite(struct rwlock *lk)
+{
+  if(!holdingwrite(lk))
+    panic("releasewrite");
+
+  lk->cpu = 0;
+  __sync_synchronize();
+  asm volatile("movl $0, %0" : "+m" (lk->writer) : );
+
+  popcli();
+}
+
+// Check whether this cpu is holding the lock for writing.
+int
+holdingwrite(struct rwlock *lk)
+{
+  int r;
+  pushcli();
+  r = lk->writer && lk->cpu == mycpu();
+  popcli();
+  return r;
+}
@@ -0,0 +1,12 @@
+// Reader-writer spin lock.
+// Any number of readers may hold the lock at once; a writer
+// excludes everyone. A waiting writer blocks new readers so
+// that a steady stream of lookups cannot starve it.
+struct rwlock {
+  volatile uint readers; // Number of readers holding the lock
+  volatile uint writer;  // Is a writer holding or waiting for it?
+
+  // For debugging:
+  char *name;        // Name of lock.
+  struct cpu *cpu;   // The cpu holding the write lock.
+};
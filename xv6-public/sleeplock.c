@@ -10,24 +10,65 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 
+// How many pause iterations to wait for a running holder
+// before giving up and going to sleep.
+#define SPINLIMIT 2000
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
-  initlock(&lk->lk, "sleep lock");
+  // Named after the sleep lock so that LOCKSTAT reports
+  // buffer and inode locks separately.
+  initlock(&lk->lk, name);
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
 }
 
+// Acquire the lock, sleeping until it is free.
+// Most holders keep a sleep lock only for a short buffer or
+// inode operation, so if the holder is running on another
+// CPU, first spin briefly: that is much cheaper than sleep(),
+// which takes ptable.lock and switches context twice.
 void
 acquiresleep(struct sleeplock *lk)
 {
+  struct proc *owner;
+  int i, spun, slept;
+
+  spun = slept = 0;
   acquire(&lk->lk);
   while (lk->locked) {
+    // Only a holder running on another CPU can release the lock
+    // while we spin. The holder may be this process: a read-ahead
+    // buffer stays locked in its name until the disk finishes.
+    owner = lk->owner;
+    if(!spun && owner && owner != myproc() && owner->state == RUNNING){
+      spun = 1;
+      release(&lk->lk);
+      for(i = 0; i < SPINLIMIT; i++){
+        if(!lk->locked || lk->owner != owner || owner->state != RUNNING)
+          break;
+        pause();
+      }
+      acquire(&lk->lk);
+      continue;
+    }
+    slept = 1;
     sleep(lk, &lk->lk);
   }
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  lk->owner = myproc();
+#ifdef LOCKSTAT
+  if(lk->lk.stat){
+    if(slept)
+      __sync_fetch_and_add(&lk->lk.stat->nsleep, 1);
+    else if(spun)
+      __sync_fetch_and_add(&lk->lk.stat->nspin, 1);
+  }
+#endif
   release(&lk->lk);
 }
 
@@ -37,6 +78,7 @@ releasesleep(struct sleeplock *lk)
   acquire(&lk->lk);
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
   wakeup(lk);
   release(&lk->lk);
 }
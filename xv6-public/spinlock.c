@@ -9,28 +9,95 @@
 #include "proc.h"
 #include "spinlock.h"
 
+#ifdef LOCKSTAT
+#define NLOCKSTAT 32
+
+// Contention statistics, one entry per lock name. The table's
+// own lock has no name, so acquiring it is never profiled.
+static struct {
+  struct spinlock lock;
+  struct lockstat stat[NLOCKSTAT];
+} lockstats;
+
+// Find or allocate the statistics entry for name.
+// Returns 0 if the table is full.
+static struct lockstat*
+lockstatlookup(char *name)
+{
+  struct lockstat *st;
+
+  acquire(&lockstats.lock);
+  for(st = lockstats.stat; st < &lockstats.stat[NLOCKSTAT]; st++){
+    if(st->name == 0)
+      st->name = name;
+    if(strncmp(st->name, name, 16) == 0){
+      release(&lockstats.lock);
+      return st;
+    }
+  }
+  release(&lockstats.lock);
+  return 0;
+}
+
+// Fold one hold time into st->maxhold. Locks sharing a name
+// release concurrently, so update with compare-and-swap.
+static void
+lockstathold(struct lockstat *st, uint64 held)
+{
+  uint64 old;
+
+  do {
+    old = st->maxhold;
+    if(held <= old)
+      return;
+  } while(!__sync_bool_compare_and_swap(&st->maxhold, old, held));
+}
+#endif
+
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->stat = 0;
 }
 
 // Acquire the lock.
 // Loops (spins) until the lock is acquired.
 // Holding a lock for a long time may cause
 // other CPUs to waste time spinning to acquire it.
+// Waiters are served in the order they arrived.
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+#ifdef LOCKSTAT
+  if(lk->stat == 0 && lk->name)
+    lk->stat = lockstatlookup(lk->name);
+#endif
+
+  // The xadd is atomic, so every CPU gets a distinct ticket.
+  ticket = fetchadd(&lk->next, 1);
+
+#ifdef LOCKSTAT
+  if(lk->stat && lk->owner != ticket){
+    uint64 t0 = rdtsc();
+    while(lk->owner != ticket)
+      pause();
+    __sync_fetch_and_add(&lk->stat->ncontend, 1);
+    __sync_fetch_and_add(&lk->stat->spin, rdtsc() - t0);
+  }
+#endif
+
+  while(lk->owner != ticket)
+    pause();
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +107,13 @@ acquire(struct spinlock *lk)
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+
+#ifdef LOCKSTAT
+  if(lk->stat){
+    __sync_fetch_and_add(&lk->stat->nacquire, 1);
+    lk->tacquire = rdtsc();
+  }
+#endif
 }
 
 // Release the lock.
@@ -49,6 +123,11 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+#ifdef LOCKSTAT
+  if(lk->stat)
+    lockstathold(lk->stat, rdtsc() - lk->tacquire);
+#endif
+
   lk->pcs[0] = 0;
   lk->cpu = 0;
 
@@ -59,10 +138,10 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Serve the next ticket. Only the holder writes owner,
+  // so the increment needs no lock prefix, but it must be
+  // a single store that the compiler cannot split or move.
+  asm volatile("incl %0" : "+m" (lk->owner) : );
 
   popcli();
 }
@@ -91,7 +170,7 @@ holding(struct spinlock *lock)
 {
   int r;
   pushcli();
-  r = lock->locked && lock->cpu == mycpu();
+  r = lock->owner != lock->next && lock->cpu == mycpu();
   popcli();
   return r;
 }
@@ -124,3 +203,38 @@ popcli(void)
     sti();
 }
 
+// Print contention statistics for every lock name seen so far,
+// then zero the counters if reset is set. Cycle counts are in
+// units of 1024 TSC cycles. Runs when user types ^L on console.
+// Returns -1 if the kernel was built without LOCKSTAT.
+int
+lockstatdump(int reset)
+{
+#ifdef LOCKSTAT
+  struct lockstat *st;
+
+  cprintf("lock: acquired contended spin-kcycles maxhold-kcycles"
+          " [sleep-lock waits: spun slept]\n");
+  for(st = lockstats.stat; st < &lockstats.stat[NLOCKSTAT]; st++){
+    if(st->name == 0)
+      break;
+    cprintf("%s: %d %d %d %d", st->name, st->nacquire, st->ncontend,
+            (uint)(st->spin >> 10), (uint)(st->maxhold >> 10));
+    if(st->nspin || st->nsleep)
+      cprintf(" [%d %d]", st->nspin, st->nsleep);
+    cprintf("\n");
+    if(reset){
+      // Racy with concurrent updates; good enough for profiling.
+      st->nacquire = 0;
+      st->ncontend = 0;
+      st->spin = 0;
+      st->maxhold = 0;
+      st->nspin = 0;
+      st->nsleep = 0;
+    }
+  }
+  return 0;
+#else
+  return -1;
+#endif
+}
@@ -1,11 +1,29 @@
 // Mutual exclusion lock.
+// A ticket lock: each acquirer takes the next ticket and
+// waits until owner reaches it, so CPUs are served in
+// FIFO order and waiters only read the shared line.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  volatile uint next;  // Next ticket to hand out
+  volatile uint owner; // Ticket of the current holder
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+
+  // For contention profiling (kernel built with LOCKSTAT):
+  struct lockstat *stat; // Statistics shared by all locks of this name
+  uint64 tacquire;       // rdtsc() when the lock was acquired
 };
 
+// Contention statistics, aggregated per lock name.
+struct lockstat {
+  char *name;
+  uint nacquire;     // Number of acquisitions
+  uint ncontend;     // Acquisitions that had to wait
+  uint64 spin;       // TSC cycles spent waiting
+  uint64 maxhold;    // Longest hold time in TSC cycles
+  uint nspin;        // Sleep-lock waits that ended while spinning
+  uint nsleep;       // Sleep-lock waits that had to sleep
+};
@@ -105,6 +105,19 @@ extern int sys_write(void);
 extern int sys_uptime(void);
 extern int sys_mmap(void);
 extern int sys_munmap(void);
+extern int sys_lockstat(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_fsstat(void);
+extern int sys_fsync(void);
+extern int sys_splice(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_pread(void);
+extern int sys_pwrite(void);
+extern int sys_ioring_enter(void);
+extern int sys_clock_gettime(void);
+extern int sys_nanosleep(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -130,6 +143,19 @@ static int (*syscalls[])(void) = {
 [SYS_close]   sys_close,
 [SYS_mmap]    sys_mmap,
 [SYS_munmap]  sys_munmap,
+[SYS_lockstat] sys_lockstat,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_fsstat]  sys_fsstat,
+[SYS_fsync]   sys_fsync,
+[SYS_splice]  sys_splice,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_ioring_enter] sys_ioring_enter,
+[SYS_clock_gettime] sys_clock_gettime,
+[SYS_nanosleep] sys_nanosleep,
 };
 
 void
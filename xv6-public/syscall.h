@@ -22,3 +22,16 @@
 #define SYS_close  21
 #define SYS_mmap   22
 #define SYS_munmap 23
+#define SYS_lockstat 24
+#define SYS_futex_wait 25
+#define SYS_futex_wake 26
+#define SYS_fsstat 27
+#define SYS_fsync  28
+#define SYS_splice 29
+#define SYS_readv  30
+#define SYS_writev 31
+#define SYS_pread  32
+#define SYS_pwrite 33
+#define SYS_ioring_enter 34
+#define SYS_clock_gettime 35
+#define SYS_nanosleep 36
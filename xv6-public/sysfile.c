@@ -15,6 +15,8 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
+#include "ioring.h"
 #include "mmap.h"
 #include "memlayout.h"
 
@@ -92,6 +94,98 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Fetch the nth and n+1th system call arguments as an array of
+// iovecs and its length, and copy the array into iov, checking
+// that every buffer lies in user memory.
+static int
+argiov(int n, struct iovec *iov, int *piovcnt)
+{
+  struct proc *curproc = myproc();
+  struct iovec *uiov;
+  int i, iovcnt, tot;
+  uint base;
+
+  if(argint(n+1, &iovcnt) < 0 || iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+  if(argptr(n, (char**)&uiov, iovcnt*sizeof(struct iovec)) < 0)
+    return -1;
+  tot = 0;
+  for(i = 0; i < iovcnt; i++){
+    iov[i] = uiov[i];
+    base = (uint)iov[i].iov_base;
+    if(iov[i].iov_len < 0 || tot + iov[i].iov_len < tot)
+      return -1;
+    if(iov[i].iov_len > 0 &&
+       (base >= curproc->sz || base+iov[i].iov_len > curproc->sz))
+      return -1;
+    tot += iov[i].iov_len;
+  }
+  *piovcnt = iovcnt;
+  return 0;
+}
+
+int
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int iovcnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &iovcnt) < 0)
+    return -1;
+  return filereadv(f, iov, iovcnt, 0);
+}
+
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int iovcnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &iovcnt) < 0)
+    return -1;
+  return filewritev(f, iov, iovcnt, 0);
+}
+
+// Read or write at the given offset in the file, without
+// using or moving the file offset.
+int
+sys_pread(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n, off;
+  char *p;
+  uint o;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  iov.iov_base = p;
+  iov.iov_len = n;
+  o = off;
+  return filereadv(f, &iov, 1, &o);
+}
+
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n, off;
+  char *p;
+  uint o;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  iov.iov_base = p;
+  iov.iov_len = n;
+  o = off;
+  return filewritev(f, &iov, 1, &o);
+}
+
 int
 sys_close(void)
 {
@@ -173,10 +267,11 @@ isdirempty(struct inode *dp)
   int off;
   struct dirent de;
 
-  for(off=2*sizeof(de); off<dp->size; off+=sizeof(de)){
+  // "." and ".." are not at fixed offsets in a hashed directory.
+  for(off=0; off<dp->size; off+=sizeof(de)){
     if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
       panic("isdirempty: readi");
-    if(de.inum != 0)
+    if(de.inum != 0 && namecmp(de.name, ".") != 0 && namecmp(de.name, "..") != 0)
       return 0;
   }
   return 1;
@@ -220,6 +315,7 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcacheenter(dp->dev, dp->inum, name, 0, 0);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -263,7 +359,7 @@ create(char *path, short type, short major, short minor)
     panic("create: ialloc");
 
   ilock(ip);
-  ip->major = major;
+  ip->major = type == T_DIR ? DIRHASHED : major;
   ip->minor = minor;
   ip->nlink = 1;
   iupdate(ip);
@@ -329,6 +425,7 @@ sys_open(void)
   f->type = FD_INODE;
   f->ip = ip;
   f->off = 0;
+  f->ranext = f->rawin = f->raend = 0;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
   return fd;
@@ -445,6 +542,112 @@ sys_pipe(void)
   return 0;
 }
 
+// Wait until the file system updates made so far,
+// including those to fd's file, are on disk.
+int
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0 || f->type != FD_INODE)
+    return -1;
+  log_sync();
+  return 0;
+}
+
+// Run one ioring submission and return what the
+// equivalent system call would have.
+static int
+ioringop(struct iosqe *e)
+{
+  struct proc *curproc = myproc();
+  struct file *f;
+  struct iovec iov;
+  uint off;
+
+  if(e->op == IORING_NOP)
+    return 0;
+  if(e->fd < 0 || e->fd >= NOFILE || (f = curproc->ofile[e->fd]) == 0)
+    return -1;
+  if(e->op == IORING_FSYNC){
+    if(f->type != FD_INODE)
+      return -1;
+    log_sync();
+    return 0;
+  }
+  if(e->n < 0 || (uint)e->buf >= curproc->sz || (uint)e->buf+e->n > curproc->sz)
+    return -1;
+  iov.iov_base = e->buf;
+  iov.iov_len = e->n;
+  off = e->off;
+  switch(e->op){
+  case IORING_READ:
+    return fileread(f, e->buf, e->n);
+  case IORING_WRITE:
+    return filewrite(f, e->buf, e->n);
+  case IORING_PREAD:
+    return e->off < 0 ? -1 : filereadv(f, &iov, 1, &off);
+  case IORING_PWRITE:
+    return e->off < 0 ? -1 : filewritev(f, &iov, 1, &off);
+  }
+  return -1;
+}
+
+// Run the operations queued in the ring, in order, as long as
+// the completion ring has room. Returns how many ran.
+int
+sys_ioring_enter(void)
+{
+  struct ioring *r;
+  struct iosqe e;
+  struct iocqe *c;
+  int n;
+
+  if(argptr(0, (char**)&r, sizeof(*r)) < 0)
+    return -1;
+  for(n = 0; r->sqhead != r->sqtail; n++){
+    if(r->cqtail - r->cqhead >= IORING_SIZE || myproc()->killed)
+      break;
+    e = r->sq[r->sqhead % IORING_SIZE];
+    r->sqhead++;
+    c = &r->cq[r->cqtail % IORING_SIZE];
+    c->data = e.data;
+    c->res = ioringop(&e);
+    r->cqtail++;
+  }
+  return n;
+}
+
+// Move up to n bytes from fdin to fdout inside the kernel;
+// one of them must be a pipe.
+int
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filesplice(in, out, n);
+}
+
+// Print file system cache statistics to the console,
+// optionally zeroing them afterwards.
+int
+sys_fsstat(void)
+{
+  int reset;
+
+  if(argint(0, &reset) < 0)
+    return -1;
+  bstat(reset);
+  idestat(reset);
+  logstat(reset);
+  istat(reset);
+  dcachestat(reset);
+  return 0;
+}
+
 void*
 sys_mmap(void)
 {
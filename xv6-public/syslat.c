@@ -0,0 +1,59 @@
+// System call latency benchmark: time n getpid() calls made
+// through the usys.S stub, which uses sysenter when the CPU
+// has it, and n made with int $T_SYSCALL directly.
+// Reports cycles per call for each.
+//
+// usage: syslat [n]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "syscall.h"
+#include "traps.h"
+
+static inline uint
+cycles(void)
+{
+  uint lo;
+
+  asm volatile("rdtsc" : "=a" (lo) : : "edx");
+  return lo;
+}
+
+static inline int
+intgetpid(void)
+{
+  int pid;
+
+  asm volatile("int %1" : "=a" (pid) : "i" (T_SYSCALL), "a" (SYS_getpid) :
+               "ecx", "edx", "memory");
+  return pid;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, i;
+  uint t0, tstub, tint;
+
+  n = argc > 1 ? atoi(argv[1]) : 10000;
+  if(n <= 0){
+    printf(2, "syslat: n must be positive\n");
+    exit();
+  }
+
+  getpid();  // let the stub pick its entry path first
+  t0 = cycles();
+  for(i = 0; i < n; i++)
+    getpid();
+  tstub = cycles() - t0;
+
+  t0 = cycles();
+  for(i = 0; i < n; i++)
+    intgetpid();
+  tint = cycles() - t0;
+
+  printf(1, "syslat: getpid %d cycles via usys.S, %d cycles via int\n",
+         tstub / n, tint / n);
+  exit();
+}
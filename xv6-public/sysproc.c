@@ -89,3 +89,61 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// Return the time since boot, to the nanosecond
+// if the TSC could be calibrated.
+int
+sys_clock_gettime(void)
+{
+  struct timespec *ts;
+
+  if(argptr(0, (char**)&ts, sizeof(*ts)) < 0)
+    return -1;
+  nanotime(ts);
+  return 0;
+}
+
+int
+sys_nanosleep(void)
+{
+  struct timespec *req, ts;
+
+  if(argptr(0, (char**)&req, sizeof(*req)) < 0)
+    return -1;
+  ts = *req;
+  if(ts.tv_nsec >= 1000000000)
+    return -1;
+  return nsleep(&ts);
+}
+
+// Print per-lock contention statistics to the console,
+// optionally zeroing them afterwards.
+int
+sys_lockstat(void)
+{
+  int reset;
+
+  if(argint(0, &reset) < 0)
+    return -1;
+  return lockstatdump(reset);
+}
+
+int
+sys_futex_wait(void)
+{
+  int addr, val;
+
+  if(argint(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futexwait(addr, val);
+}
+
+int
+sys_futex_wake(void)
+{
+  int addr, n;
+
+  if(argint(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futexwake(addr, n);
+}
@@ -7,10 +7,12 @@
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
+#include "vdata.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
+extern void sysentry(void);  // in trapasm.S
 struct spinlock tickslock;
 uint ticks;
 
@@ -44,10 +46,33 @@ idtinit(void)
   lidt(idt, sizeof(idt));
 }
 
+int sysenterok;   // CPUs take system calls through sysenter
+
+// Let this CPU's user code enter the kernel with sysenter, which
+// is much cheaper than int $T_SYSCALL. sysenter loads the kernel
+// code segment and jumps to sysentry (trapasm.S); switchuvm()
+// points the stack at the process's kernel stack. usys.S makes
+// the same check as this before using sysenter.
+void
+sysenterinit(void)
+{
+  uint eax, ebx, ecx, edx;
+
+  cpuinfo(1, &eax, &ebx, &ecx, &edx);
+  // The first Pentium Pros claim SEP but lack the instructions.
+  if((edx & CPUID_SEP) == 0 || (eax & 0x0FFF3FFF) < 0x633)
+    return;
+  wrmsr(MSR_SYSENTER_CS, SEG_KCODE<<3);
+  wrmsr(MSR_SYSENTER_EIP, (uint)sysentry);
+  sysenterok = 1;
+}
+
 //PAGEBREAK: 41
 void
 trap(struct trapframe *tf)
 {
+  int n;
+
   // Handle page faults (interrupt number 14)
   if (tf->trapno == 14) {
     uint faulting_address = rcr2(); // Get faulting address
@@ -83,9 +108,18 @@ trap(struct trapframe *tf)
       }
     }
 
+    // The shared pages at VDATA and VPROC are read-only for good;
+    // a write to them is the process's fault, not copy-on-write.
+    if (faulting_address >= VDATA) {
+      cprintf("pid %d %s: write to read-only page 0x%x--kill proc\n",
+              curproc->pid, curproc->name, faulting_address);
+      curproc->killed = 1;
+      return;
+    }
+
     // Check for write to a read-only page in a MAP_PRIVATE mapping
     pte_t *pte = walkpgdir(myproc()->pgdir, (void *)faulting_address, 0);
-    if (pte && (*pte & PTE_P) && !(*pte & PTE_W)) { // CoW fault if page is present and not writable
+    if (pte && (*pte & PTE_P) && (*pte & PTE_U) && !(*pte & PTE_W)) { // CoW fault if user page is present and not writable
       
       struct proc *curproc2 = myproc();
       char *mem = kalloc();
@@ -98,14 +132,10 @@ trap(struct trapframe *tf)
       uint a = PGROUNDDOWN(faulting_address);
       memmove(mem, (char*)a, PGSIZE);
 
-      if (mappages(curproc2->pgdir, (void*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0) {
-          cprintf("mappages failed (CoW)\n");
-          kfree(mem);
-          curproc2->killed = 1;
-          return;
-      }
-      
-      
+      // The PTE is already present, so replace it in place rather
+      // than calling mappages(), which would panic with "remap".
+      *pte = V2P(mem) | PTE_P | PTE_W | PTE_U;
+      lcr3(V2P(curproc2->pgdir));  // flush the stale TLB entry
       return;
     }
 
@@ -115,6 +145,15 @@ trap(struct trapframe *tf)
     return;
   }
 
+  // sysenter does not clear TF, so a process that sets it and
+  // enters a system call traps on sysentry's first instruction.
+  // Clear TF and carry on; the process loses its single step.
+  if(tf->trapno == T_DEBUG && (tf->cs&3) == 0 &&
+     tf->eip == (uint)sysentry){
+    tf->eflags &= ~FL_TF;
+    return;
+  }
+
   if(tf->trapno == T_SYSCALL){
     if(myproc()->killed)
       exit();
@@ -127,9 +166,10 @@ trap(struct trapframe *tf)
 
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
-    if(cpuid() == 0){
+    if((n = clockintr()) > 0 && cpuid() == 0){
       acquire(&tickslock);
-      ticks++;
+      ticks += n;
+      vdatatick();
       wakeup(&ticks);
       release(&tickslock);
     }
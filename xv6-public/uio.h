@@ -0,0 +1,7 @@
+// A buffer for readv() and writev().
+struct iovec {
+  void *iov_base;  // Start of the buffer
+  int iov_len;     // Size of the buffer in bytes
+};
+
+#define IOV_MAX 16   // most buffers readv() and writev() take
@@ -3,6 +3,7 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "vdata.h"
 
 char*
 strcpy(char *s, const char *t)
@@ -104,3 +105,112 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// Mutexes and condition variables built on futexes.
+// The mutex is the three-state lock from Drepper's
+// "Futexes Are Tricky": unlock only enters the kernel
+// when some process may be sleeping in futex_wait.
+
+void
+mutexinit(struct mutex *m)
+{
+  m->state = 0;
+}
+
+void
+mutexlock(struct mutex *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = __sync_lock_test_and_set(&m->state, 2);
+  while(c != 0){
+    futex_wait(&m->state, 2);
+    c = __sync_lock_test_and_set(&m->state, 2);
+  }
+}
+
+void
+mutexunlock(struct mutex *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    m->state = 0;
+    futex_wake(&m->state, 1);
+  }
+}
+
+void
+condinit(struct cond *c)
+{
+  c->seq = 0;
+}
+
+// Release m, wait for a signal, and reacquire m.
+// As with any condition variable, callers must recheck
+// their predicate in a loop.
+void
+condwait(struct cond *c, struct mutex *m)
+{
+  int seq;
+
+  seq = c->seq;
+  mutexunlock(m);
+  futex_wait(&c->seq, seq);
+  mutexlock(m);
+}
+
+void
+condsignal(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 1);
+}
+
+void
+condbroadcast(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 0x7fffffff);  // all waiters
+}
+
+// Read the time and pid from the pages the kernel maps at
+// VDATA and VPROC, without a system call.
+uint
+vticks(void)
+{
+  return ((volatile struct vdata*)VDATA)->ticks;
+}
+
+int
+vgetpid(void)
+{
+  return ((struct vproc*)VPROC)->pid;
+}
+
+// Return ticks since boot, like uptime(), and set *frac to
+// the thousandths of a tick since that tick, measured with
+// the time stamp counter. *frac is 0 until the kernel has
+// calibrated the counter.
+uint
+vclock(uint *frac)
+{
+  volatile struct vdata *v = (volatile struct vdata*)VDATA;
+  uint seq, t, per, d;
+  uint64 tsc;
+
+  do {
+    while((seq = v->seq) & 1)
+      pause();
+    t = v->ticks;
+    tsc = v->tsc;
+    per = v->tscpertick;
+  } while(v->seq != seq);
+  d = rdtsc() - tsc;
+  per /= 1000;
+  *frac = per ? d / per : 0;
+  if(*frac > 999)
+    *frac = 999;
+  return t;
+}
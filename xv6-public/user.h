@@ -1,5 +1,17 @@
 struct stat;
 struct rtcdate;
+struct iovec;
+struct ioring;
+struct timespec;
+
+// Futex-based locks for processes sharing memory (see ulib.c).
+struct mutex {
+  int state;   // 0 unlocked, 1 locked, 2 locked with waiters
+};
+
+struct cond {
+  int seq;     // Bumped on every signal
+};
 
 // system calls
 int fork(void);
@@ -25,6 +37,19 @@ int sleep(int);
 int uptime(void);
 void* mmap(void *addr, int length, int prot, int flags, int fd, int offset);
 int munmap(void *addr, int length);
+int lockstat(int reset);
+int futex_wait(int *addr, int val);
+int futex_wake(int *addr, int n);
+int fsstat(int reset);
+int fsync(int);
+int splice(int, int, int);
+int readv(int, struct iovec*, int);
+int writev(int, struct iovec*, int);
+int pread(int, void*, int, int);
+int pwrite(int, void*, int, int);
+int ioring_enter(struct ioring*);
+int clock_gettime(struct timespec*);
+int nanosleep(struct timespec*);
 
 
 // ulib.c
@@ -40,3 +65,13 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+void mutexinit(struct mutex*);
+void mutexlock(struct mutex*);
+void mutexunlock(struct mutex*);
+void condinit(struct cond*);
+void condwait(struct cond*, struct mutex*);
+void condsignal(struct cond*);
+void condbroadcast(struct cond*);
+uint vticks(void);
+int vgetpid(void);
+uint vclock(uint*);
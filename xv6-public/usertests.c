@@ -4,6 +4,10 @@
 #include "user.h"
 #include "fs.h"
 #include "fcntl.h"
+#include "uio.h"
+#include "ioring.h"
+#include "vdata.h"
+#include "date.h"
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
@@ -184,6 +188,11 @@ writetest(void)
   printf(stdout, "small file test ok\n");
 }
 
+// Blocks in a file that uses the double-indirect block and two of
+// the indirect blocks under it, whatever BSIZE is. MAXFILE itself
+// is larger than the file system.
+#define BIGFILE (NDIRECT + 2*NINDIRECT + 1)
+
 void
 writetest1(void)
 {
@@ -197,9 +206,9 @@ writetest1(void)
     exit();
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < BIGFILE; i++){
     ((int*)buf)[0] = i;
-    if(write(fd, buf, 512) != 512){
+    if(write(fd, buf, BSIZE) != BSIZE){
       printf(stdout, "error: write big file failed\n", i);
       exit();
     }
@@ -215,14 +224,14 @@ writetest1(void)
 
   n = 0;
   for(;;){
-    i = read(fd, buf, 512);
+    i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != BIGFILE){
         printf(stdout, "read only %d blocks from big", n);
         exit();
       }
       break;
-    } else if(i != 512){
+    } else if(i != BSIZE){
       printf(stdout, "read failed %d\n", i);
       exit();
     }
@@ -300,7 +309,8 @@ exectest(void)
   }
 }
 
-// simple fork and pipe read/write
+// simple fork and pipe read/write; writes more than
+// the pipe holds, so the ring wraps and the writer sleeps.
 
 void
 pipe1(void)
@@ -316,7 +326,7 @@ pipe1(void)
   seq = 0;
   if(pid == 0){
     close(fds[0]);
-    for(n = 0; n < 5; n++){
+    for(n = 0; n < 20; n++){
       for(i = 0; i < 1033; i++)
         buf[i] = seq++;
       if(write(fds[1], buf, 1033) != 1033){
@@ -341,7 +351,7 @@ pipe1(void)
       if(cc > sizeof(buf))
         cc = sizeof(buf);
     }
-    if(total != 5 * 1033){
+    if(total != 20 * 1033){
       printf(1, "pipe1 oops 3 total %d\n", total);
       exit();
     }
@@ -1737,6 +1747,512 @@ void argptest()
   printf(1, "arg test passed\n");
 }
 
+// futex_wait must refuse to sleep when the word has changed,
+// and the futex mutex must work without contention.
+void
+futextest(void)
+{
+  static int word;
+  struct mutex m;
+
+  printf(stdout, "futex test\n");
+  word = 1;
+  if(futex_wait(&word, 0) != -1){
+    printf(stdout, "futex_wait on changed word did not fail\n");
+    exit();
+  }
+  if(futex_wait((int*)(KERNBASE+4), 0) != -1 || futex_wake((int*)1, 1) != -1){
+    printf(stdout, "futex accepted a bad address\n");
+    exit();
+  }
+  if(futex_wake(&word, 1) != 0){
+    printf(stdout, "futex_wake woke a process that was not waiting\n");
+    exit();
+  }
+  mutexinit(&m);
+  mutexlock(&m);
+  if(m.state != 1){
+    printf(stdout, "mutexlock did not lock\n");
+    exit();
+  }
+  mutexunlock(&m);
+  if(m.state != 0){
+    printf(stdout, "mutexunlock did not unlock\n");
+    exit();
+  }
+  printf(stdout, "futex test ok\n");
+}
+
+// Processes share no writable memory here (sys_mmap has no
+// MAP_SHARED), but they all share the read-only VDATA page, so a
+// child can sleep on its tick count and the parent wake it.
+// The contended mutex and condition variable paths are checked
+// to sleep rather than return, and to leave when killed.
+void
+futexwaketest(void)
+{
+  volatile struct vdata *vd = (struct vdata*)VDATA;
+  struct mutex m;
+  struct cond c;
+  int p[2], pid, i, n;
+  uint t;
+  char b[1];
+
+  printf(stdout, "futex wake test\n");
+  if(pipe(p) != 0){
+    printf(stdout, "pipe() failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    // A tick between reading the word and waiting makes
+    // futex_wait fail at once, so try again.
+    do
+      t = vd->ticks;
+    while(futex_wait((int*)&vd->ticks, t) != 0);
+    write(p[1], "w", 1);
+    exit();
+  }
+  // futex_wake counts the processes it wakes, so it returns 1
+  // only once the child is asleep.
+  for(i = 0; i < 500 && futex_wake((int*)&vd->ticks, 1) != 1; i++)
+    sleep(1);
+  if(i == 500 || read(p[0], b, 1) != 1 || b[0] != 'w'){
+    printf(stdout, "futex_wake did not wake the child\n");
+    kill(pid);
+    exit();
+  }
+  wait();
+
+  // Unlocking a mutex marked as having waiters takes the slow path.
+  mutexinit(&m);
+  m.state = 2;
+  mutexunlock(&m);
+  if(m.state != 0){
+    printf(stdout, "contended mutexunlock did not unlock\n");
+    exit();
+  }
+
+  // A contended mutexlock and a condwait with no signal
+  // must sleep until the process is killed.
+  for(n = 0; n < 2; n++){
+    pid = fork();
+    if(pid < 0){
+      printf(stdout, "fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      mutexinit(&m);
+      condinit(&c);
+      if(n == 0){
+        m.state = 1;        // as if another process held it
+        mutexlock(&m);
+      } else {
+        mutexlock(&m);
+        condwait(&c, &m);
+      }
+      write(p[1], "r", 1);
+      exit();
+    }
+    sleep(5);
+    kill(pid);
+    wait();
+  }
+  close(p[1]);
+  if(read(p[0], b, 1) != 0){
+    printf(stdout, "mutexlock or condwait returned without a wakeup\n");
+    exit();
+  }
+  close(p[0]);
+  printf(stdout, "futex wake test ok\n");
+}
+
+// fsync works on files and refuses pipes.
+void
+fsynctest(void)
+{
+  int fd, p[2];
+
+  printf(stdout, "fsync test\n");
+  fd = open("fsyncfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "create fsyncfile failed\n");
+    exit();
+  }
+  if(write(fd, "aaaa", 4) != 4 || fsync(fd) != 0){
+    printf(stdout, "fsync of written file failed\n");
+    exit();
+  }
+  if(fsync(fd) != 0){
+    printf(stdout, "fsync with nothing to commit failed\n");
+    exit();
+  }
+  close(fd);
+  unlink("fsyncfile");
+  if(pipe(p) != 0){
+    printf(stdout, "pipe() failed\n");
+    exit();
+  }
+  if(fsync(p[0]) != -1){
+    printf(stdout, "fsync of pipe succeeded\n");
+    exit();
+  }
+  close(p[0]);
+  close(p[1]);
+  printf(stdout, "fsync test ok\n");
+}
+
+// hold more inodes open at once than the
+// static part of the inode cache (NINODE, 50).
+void
+manyinodes(void)
+{
+  enum { NCHILD = 8, NPER = 10 };
+  int ready[2], done[2], fds[NPER], c, i, pid, failed;
+  char name[8], buf[1];
+
+  printf(stdout, "many inodes test\n");
+  if(pipe(ready) != 0 || pipe(done) != 0){
+    printf(stdout, "pipe() failed\n");
+    exit();
+  }
+  for(c = 0; c < NCHILD; c++){
+    pid = fork();
+    if(pid < 0){
+      printf(stdout, "fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      close(ready[0]);
+      close(done[1]);
+      name[0] = 'n';
+      name[1] = 'i';
+      name[2] = 'a' + c;
+      name[4] = '\0';
+      for(i = 0; i < NPER; i++){
+        name[3] = '0' + i;
+        if((fds[i] = open(name, O_CREATE|O_RDWR)) < 0){
+          printf(stdout, "create %s failed\n", name);
+          break;
+        }
+      }
+      // Always answer, so the parent does not wait forever.
+      write(ready[1], i < NPER ? "f" : "x", 1);
+      if(i == NPER)
+        read(done[0], buf, 1);
+      while(--i >= 0){
+        name[3] = '0' + i;
+        close(fds[i]);
+        unlink(name);
+      }
+      exit();
+    }
+  }
+  close(ready[1]);
+  close(done[0]);
+  failed = 0;
+  for(c = 0; c < NCHILD; c++){
+    if(read(ready[0], buf, 1) != 1 || buf[0] != 'x')
+      failed = 1;
+  }
+  close(done[1]);
+  for(c = 0; c < NCHILD; c++)
+    wait();
+  close(ready[0]);
+  if(failed){
+    printf(stdout, "many inodes: child failed\n");
+    exit();
+  }
+  printf(stdout, "many inodes test ok\n");
+}
+
+// splice a file into a pipe and the pipe into another file.
+void
+splicetest(void)
+{
+  enum { SZ = 5000 };  // fits in buf and in the pipe
+  int fd, fd1, p[2], i, n;
+
+  printf(stdout, "splice test\n");
+  fd = open("splicein", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "create splicein failed\n");
+    exit();
+  }
+  for(i = 0; i < SZ; i++)
+    buf[i] = i % 251;
+  if(write(fd, buf, SZ) != SZ){
+    printf(stdout, "write splicein failed\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("splicein", O_RDONLY);
+  fd1 = open("spliceout", O_CREATE|O_RDWR);
+  if(fd < 0 || fd1 < 0 || pipe(p) != 0){
+    printf(stdout, "splice setup failed\n");
+    exit();
+  }
+  if(splice(fd, fd1, 10) != -1){
+    printf(stdout, "splice without a pipe succeeded\n");
+    exit();
+  }
+  if(splice(fd, p[1], SZ) != SZ){
+    printf(stdout, "splice file to pipe failed\n");
+    exit();
+  }
+  if(splice(fd, p[1], SZ) != 0){
+    printf(stdout, "splice at end of file did not return 0\n");
+    exit();
+  }
+  close(p[1]);
+  for(i = 0; i < SZ; i += n){
+    if((n = splice(p[0], fd1, SZ)) <= 0){
+      printf(stdout, "splice pipe to file failed\n");
+      exit();
+    }
+  }
+  if(i != SZ || splice(p[0], fd1, SZ) != 0){
+    printf(stdout, "splice pipe to file moved %d bytes\n", i);
+    exit();
+  }
+  close(p[0]);
+  close(fd);
+  close(fd1);
+
+  fd = open("spliceout", O_RDONLY);
+  memset(buf, 0, SZ);
+  if(read(fd, buf, sizeof(buf)) != SZ){
+    printf(stdout, "spliceout has the wrong size\n");
+    exit();
+  }
+  for(i = 0; i < SZ; i++){
+    if((buf[i] & 0xff) != i % 251){
+      printf(stdout, "spliceout wrong at %d\n", i);
+      exit();
+    }
+  }
+  close(fd);
+  unlink("splicein");
+  unlink("spliceout");
+  printf(stdout, "splice test ok\n");
+}
+
+// writev/readv with uneven buffers, larger in total than one
+// log transaction; pread/pwrite leave the file offset alone.
+void
+viotest(void)
+{
+  static int len[4] = { 100, 2000, 3000, 1000 };
+  enum { SZ = 6100 };
+  struct iovec iov[4];
+  char c[4];
+  int fd, i, off;
+
+  printf(stdout, "vectored io test\n");
+  for(i = 0; i < SZ; i++)
+    buf[i] = i % 253;
+  off = 0;
+  for(i = 0; i < 4; i++){
+    iov[i].iov_base = buf + off;
+    iov[i].iov_len = len[i];
+    off += len[i];
+  }
+  fd = open("viofile", O_CREATE|O_RDWR);
+  if(fd < 0 || writev(fd, iov, 4) != SZ){
+    printf(stdout, "writev failed\n");
+    exit();
+  }
+  if(pwrite(fd, "abcd", 4, 2998) != 4 || write(fd, "z", 1) != 1){
+    printf(stdout, "pwrite failed\n");
+    exit();
+  }
+  if(pread(fd, c, 4, 2998) != 4 || c[0] != 'a' || c[3] != 'd'){
+    printf(stdout, "pread failed\n");
+    exit();
+  }
+  if(pread(fd, c, 4, 1000000) != 0){
+    printf(stdout, "pread past EOF failed\n");
+    exit();
+  }
+  close(fd);
+
+  // read it back in buffers of different sizes.
+  memset(buf, 0, SZ + 1);
+  fd = open("viofile", O_RDONLY);
+  off = 0;
+  for(i = 0; i < 4; i++){
+    iov[i].iov_base = buf + off;
+    iov[i].iov_len = len[3-i];
+    off += len[3-i];
+  }
+  if(readv(fd, iov, 4) != SZ || read(fd, c, 1) != 1 || c[0] != 'z'){
+    printf(stdout, "readv failed\n");
+    exit();
+  }
+  for(i = 0; i < SZ; i++){
+    if(i >= 2998 && i < 3002){
+      if(buf[i] != "abcd"[i-2998])
+        break;
+    } else if((buf[i] & 0xff) != i % 253)
+      break;
+  }
+  if(i != SZ){
+    printf(stdout, "viofile wrong at %d\n", i);
+    exit();
+  }
+  close(fd);
+  unlink("viofile");
+  printf(stdout, "vectored io test ok\n");
+}
+
+// queue file operations in an ioring and run them with
+// one system call; a full completion ring stops submission.
+struct ioring ring;
+
+void
+ioringsub(int op, int fd, void *buf, int n, int off)
+{
+  struct iosqe *e;
+
+  e = &ring.sq[ring.sqtail % IORING_SIZE];
+  e->op = op;
+  e->fd = fd;
+  e->buf = buf;
+  e->n = n;
+  e->off = off;
+  e->data = ring.sqtail;
+  ring.sqtail++;
+}
+
+void
+ioringtest(void)
+{
+  static int want[7] = { 5, 5, 5, 0, 5, 5, -1 };
+  struct iocqe *c;
+  char rbuf[11];
+  int fd, i;
+
+  printf(stdout, "ioring test\n");
+  fd = open("ioringfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "create ioringfile failed\n");
+    exit();
+  }
+  ioringsub(IORING_WRITE, fd, "hello", 5, 0);
+  ioringsub(IORING_WRITE, fd, "world", 5, 0);
+  ioringsub(IORING_PWRITE, fd, "HELLO", 5, 0);
+  ioringsub(IORING_FSYNC, fd, 0, 0, 0);
+  ioringsub(IORING_PREAD, fd, rbuf, 5, 0);
+  ioringsub(IORING_PREAD, fd, rbuf+5, 5, 5);
+  ioringsub(IORING_READ, NOFILE, rbuf, 5, 0);
+  if(ioring_enter(&ring) != 7 || ring.sqhead != 7 || ring.cqtail != 7){
+    printf(stdout, "ioring_enter did not run 7 operations\n");
+    exit();
+  }
+  for(; ring.cqhead != ring.cqtail; ring.cqhead++){
+    c = &ring.cq[ring.cqhead % IORING_SIZE];
+    if(c->data != ring.cqhead || c->res != want[ring.cqhead]){
+      printf(stdout, "ioring completion %d: %d\n", ring.cqhead, c->res);
+      exit();
+    }
+  }
+  rbuf[10] = '\0';
+  if(strcmp(rbuf, "HELLOworld") != 0){
+    printf(stdout, "ioring read wrong data\n");
+    exit();
+  }
+  close(fd);
+  unlink("ioringfile");
+
+  for(i = 0; i < IORING_SIZE + 8; i++)
+    ioringsub(IORING_NOP, 0, 0, 0, 0);
+  if(ioring_enter(&ring) != IORING_SIZE){
+    printf(stdout, "ioring_enter overran the completion ring\n");
+    exit();
+  }
+  ring.cqhead = ring.cqtail;
+  if(ioring_enter(&ring) != 8 || ring.sqhead != ring.sqtail){
+    printf(stdout, "ioring_enter did not finish the queue\n");
+    exit();
+  }
+  printf(stdout, "ioring test ok\n");
+}
+
+// the read-only pages at VDATA and VPROC agree with the
+// system calls, and user code cannot write them.
+void
+vdatatest(void)
+{
+  uint t, frac;
+  int pid, ppid;
+
+  printf(stdout, "vdata test\n");
+  ppid = getpid();
+  t = uptime();
+  if(vgetpid() != getpid() || vticks() < t || vticks() > t + 1){
+    printf(stdout, "vdata disagrees with getpid or uptime\n");
+    exit();
+  }
+  if(vclock(&frac) < t || frac > 999){
+    printf(stdout, "vclock wrong\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(vgetpid() != getpid()){
+      printf(stdout, "vgetpid wrong in child\n");
+      exit();
+    }
+    *(int*)VPROC = 0;
+    printf(stdout, "wrote VPROC\n");
+    kill(ppid);
+    exit();
+  }
+  wait();
+  if(sbrk(0) > (char*)VDATA - 1 || sbrk(VDATA) != (char*)-1){
+    printf(stdout, "sbrk reached VDATA\n");
+    exit();
+  }
+  printf(stdout, "vdata test ok\n");
+}
+
+// clock_gettime() moves forward and nanosleep() sleeps
+// at least as long as asked.
+void
+clocktest(void)
+{
+  struct timespec a, b, req;
+  uint us;
+
+  printf(stdout, "clock test\n");
+  req.tv_sec = 0;
+  req.tv_nsec = 1000000000;
+  if(nanosleep(&req) != -1){
+    printf(stdout, "nanosleep took tv_nsec of a second\n");
+    exit();
+  }
+  req.tv_nsec = 2000000;
+  if(clock_gettime(&a) != 0 || nanosleep(&req) != 0 || clock_gettime(&b) != 0){
+    printf(stdout, "clock_gettime or nanosleep failed\n");
+    exit();
+  }
+  us = (b.tv_sec - a.tv_sec)*1000000 + b.tv_nsec/1000 - a.tv_nsec/1000;
+  if(b.tv_sec < a.tv_sec || us < 1999){
+    printf(stdout, "nanosleep of 2ms took %d us\n", us);
+    exit();
+  }
+  printf(stdout, "clock test ok\n");
+}
+
 unsigned long randstate = 1;
 unsigned int
 rand()
@@ -1781,6 +2297,14 @@ main(int argc, char *argv[])
 
   mem();
   pipe1();
+  futextest();
+  futexwaketest();
+  fsynctest();
+  splicetest();
+  viotest();
+  ioringtest();
+  vdatatest();
+  clocktest();
   preempt();
   exitwait();
 
@@ -1792,6 +2316,7 @@ main(int argc, char *argv[])
   unlinkread();
   dirfile();
   iref();
+  manyinodes();
   forktest();
   bigdir(); // slow
 
@@ -0,0 +1,44 @@
+// The data page the kernel shares read-only with every
+// process at VDATA (see vdata.h). trap() calls vdatatick()
+// on each timer tick; a reader that sees vdata->seq odd, or
+// changed by the time it has read the rest, tries again.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "vdata.h"
+
+struct vdata *vdata;
+
+void
+vdatainit(void)
+{
+  if((vdata = (struct vdata*)kalloc()) == 0)
+    panic("vdatainit");
+  memset(vdata, 0, PGSIZE);
+}
+
+// Record a clock tick. Caller must hold tickslock.
+void
+vdatatick(void)
+{
+  uint64 tsc;
+  uint d;
+
+  tsc = rdtsc();
+  d = tsc - vdata->tsc;
+  vdata->seq++;
+  __sync_synchronize();
+  // Without calibration, average the cycles between ticks;
+  // the first tick after boot has no previous one to measure from.
+  if(tsckhz)
+    vdata->tscpertick = tsckhz*(1000/TICKHZ);
+  else if(vdata->tsc != 0)
+    vdata->tscpertick = vdata->tscpertick ? (vdata->tscpertick*7 + d) / 8 : d;
+  vdata->ticks = ticks;
+  vdata->tsc = tsc;
+  __sync_synchronize();
+  vdata->seq++;
+}
@@ -0,0 +1,18 @@
+// Pages the kernel maps read-only into every process, so that
+// user code can read the time and its pid without a system call
+// (see vticks() and friends in ulib.c). VDATA is shared by all
+// processes; VPROC is the process's own.
+
+#define VDATA 0x7FFFE000   // KERNBASE - 2*PGSIZE
+#define VPROC 0x7FFFF000   // KERNBASE - PGSIZE
+
+struct vdata {
+  volatile uint seq;   // odd while the kernel updates the rest
+  uint ticks;          // trap.c's ticks
+  uint64 tsc;          // CPU 0's time stamp counter at that tick
+  uint tscpertick;     // TSC cycles per tick, averaged; 0 until known
+};
+
+struct vproc {
+  int pid;             // process ID
+};
@@ -6,6 +6,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "vdata.h"
 #include "mmap.h"
 
 extern char data[];  // defined by kernel.ld
@@ -342,6 +343,8 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
+  if(sysenterok)
+    wrmsr(MSR_SYSENTER_ESP, (uint)p->kstack + KSTACKSIZE);
   lcr3(V2P(p->pgdir));  // switch to process's address space
   popcli();
 }
@@ -393,7 +396,7 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   char *mem;
   uint a;
 
-  if(newsz >= KERNBASE)
+  if(newsz > VDATA)
     return 0;
   if(newsz < oldsz)
     return oldsz;
@@ -456,7 +459,7 @@ freevm(pde_t *pgdir)
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
-  deallocuvm(pgdir, KERNBASE, 0);
+  deallocuvm(pgdir, VDATA, 0);  // the vdata pages are not the process's
   for(i = 0; i < NPDENTRIES; i++){
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
@@ -466,6 +469,17 @@ freevm(pde_t *pgdir)
   kfree((char*)pgdir);
 }
 
+// Map the shared data page at VDATA and p's own page at VPROC,
+// read-only. freevm() leaves both pages alone.
+int
+mapvdata(pde_t *pgdir, struct proc *p)
+{
+  if(mappages(pgdir, (char*)VDATA, PGSIZE, V2P(vdata), PTE_U) < 0 ||
+     mappages(pgdir, (char*)VPROC, PGSIZE, V2P(p->vproc), PTE_U) < 0)
+    return -1;
+  return 0;
+}
+
 // Clear PTE_U on a page. Used to create an inaccessible
 // page beneath the user stack.
 void
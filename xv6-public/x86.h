@@ -9,6 +9,15 @@ inb(ushort port)
   return data;
 }
 
+static inline uint
+inl(ushort port)
+{
+  uint data;
+
+  asm volatile("in %1,%0" : "=a" (data) : "d" (port));
+  return data;
+}
+
 static inline void
 insl(int port, void *addr, int cnt)
 {
@@ -30,6 +39,12 @@ outw(ushort port, ushort data)
   asm volatile("out %0,%1" : : "a" (data), "d" (port));
 }
 
+static inline void
+outl(ushort port, uint data)
+{
+  asm volatile("out %0,%1" : : "a" (data), "d" (port));
+}
+
 static inline void
 outsl(int port, const void *addr, int cnt)
 {
@@ -130,6 +145,59 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Atomically add incr to *addr and return the old value.
+static inline uint
+fetchadd(volatile uint *addr, uint incr)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (incr), "+m" (*addr) :
+               :
+               "cc");
+  return incr;
+}
+
+// Spin-wait hint: lets a hyperthread sibling run and avoids
+// the memory-order flush when the awaited store arrives.
+// Also a compiler barrier, so spin loops re-read memory.
+static inline void
+pause(void)
+{
+  asm volatile("pause" : : : "memory");
+}
+
+static inline uint64
+rdtsc(void)
+{
+  uint64 val;
+  asm volatile("rdtsc" : "=A" (val));
+  return val;
+}
+
+static inline void
+cpuinfo(uint leaf, uint *eaxp, uint *ebxp, uint *ecxp, uint *edxp)
+{
+  asm volatile("cpuid" :
+               "=a" (*eaxp), "=b" (*ebxp), "=c" (*ecxp), "=d" (*edxp) :
+               "a" (leaf), "c" (0));
+}
+
+static inline void
+wrmsr(uint msr, uint64 val)
+{
+  asm volatile("wrmsr" : : "c" (msr), "A" (val));
+}
+
+// Return a*b/c, computing a*b in 64 bits.
+// The quotient must fit in 32 bits.
+static inline uint
+muldiv(uint a, uint b, uint c)
+{
+  uint q, r;
+
+  asm("mull %2; divl %3" : "=&a" (q), "=&d" (r) : "rm" (b), "rm" (c), "0" (a));
+  return q;
+}
+
 static inline uint
 rcr2(void)
 {